@@ -356,6 +356,49 @@ int Connection::Stop(const std::string &name, int timeout) {
     return Impl->Rpc();
 }
 
+static void BulkResults(const rpc::TContainerBulkResponse &rsp,
+                        std::vector<BulkResult> &results) {
+    results.clear();
+    for (const auto &res: rsp.result())
+        results.push_back({res.name(), (int)res.error(),
+                           res.errormsg(), res.time_ms()});
+}
+
+int Connection::StartBulk(const std::vector<std::string> &names,
+                          std::vector<BulkResult> &results,
+                          const std::string &subtree) {
+    auto bulk = Impl->Req.mutable_bulk();
+
+    for (const auto &name: names)
+        bulk->add_name(name);
+    if (subtree.size())
+        bulk->set_subtree(subtree);
+
+    int ret = Impl->Rpc();
+    if (!ret)
+        BulkResults(Impl->Rsp.bulk(), results);
+    return ret;
+}
+
+int Connection::StopBulk(const std::vector<std::string> &names,
+                         std::vector<BulkResult> &results,
+                         const std::string &subtree, int timeout) {
+    auto bulk = Impl->Req.mutable_bulk();
+
+    for (const auto &name: names)
+        bulk->add_name(name);
+    if (subtree.size())
+        bulk->set_subtree(subtree);
+    bulk->set_stop(true);
+    if (timeout >= 0)
+        bulk->set_timeout_ms(timeout * 1000);
+
+    int ret = Impl->Rpc();
+    if (!ret)
+        BulkResults(Impl->Rsp.bulk(), results);
+    return ret;
+}
+
 int Connection::Kill(const std::string &name, int sig) {
     Impl->Req.mutable_kill()->set_name(name);
     Impl->Req.mutable_kill()->set_sig(sig);
@@ -566,6 +609,20 @@ int Connection::ListLayers(std::vector<std::string> &layers, const std::string &
     return ret;
 }
 
+int Connection::CollectLayers(std::vector<std::string> &layers, bool dry_run,
+                              const std::string &place) {
+    auto req = Impl->Req.mutable_collectlayers();
+    if (place.size())
+        req->set_place(place);
+    req->set_dry_run(dry_run);
+    int ret = Impl->Rpc();
+    if (!ret) {
+        const auto &list = Impl->Rsp.layers().layer();
+        layers.assign(std::begin(list), std::end(list));
+    }
+    return ret;
+}
+
 int Connection::ConvertPath(const std::string &path, const std::string &src,
                            const std::string &dest, std::string &res) {
     auto req = Impl->Req.mutable_convertpath();
@@ -24,6 +24,13 @@ struct GetResponse {
     std::string ErrorMsg;
 };
 
+struct BulkResult {
+    std::string Name;
+    int Error;
+    std::string ErrorMsg;
+    uint64_t TimeMs;
+};
+
 class Connection {
     class ConnectionImpl;
 
@@ -53,6 +60,14 @@ public:
     int Pause(const std::string &name);
     int Resume(const std::string &name);
 
+    /* start/stop listed containers and/or whole subtree in parallel */
+    int StartBulk(const std::vector<std::string> &names,
+                  std::vector<BulkResult> &results,
+                  const std::string &subtree = "");
+    int StopBulk(const std::vector<std::string> &names,
+                 std::vector<BulkResult> &results,
+                 const std::string &subtree = "", int timeout = -1);
+
     int WaitContainers(const std::vector<std::string> &containers,
                        std::string &name, int timeout);
 
@@ -101,6 +116,8 @@ public:
     int RemoveLayer(const std::string &layer, const std::string &place = "");
     int ListLayers(std::vector<std::string> &layers,
                    const std::string &place = "");
+    int CollectLayers(std::vector<std::string> &layers, bool dry_run = false,
+                      const std::string &place = "");
 
     int ConvertPath(const std::string &path, const std::string &src,
                     const std::string &dest, std::string &res);
@@ -190,6 +190,21 @@ class _RPC(object):
             timeout_s = 30
         self.call(request, max(self.timeout, timeout_s + 1))
 
+    def Bulk(self, names=[], subtree=None, state=None, stop=False, timeout_s=None, threads=None):
+        request = rpc_pb2.TContainerRequest()
+        request.bulk.name.extend(names)
+        if subtree is not None:
+            request.bulk.subtree = subtree
+        if state is not None:
+            request.bulk.state = state
+        request.bulk.stop = stop
+        if timeout_s is not None and timeout_s >= 0:
+            request.bulk.timeout_ms = timeout_s * 1000
+        if threads is not None:
+            request.bulk.threads = threads
+        resp = self.call(request, None)
+        return {r.name: (r.error, r.errorMsg, r.time_ms) for r in resp.bulk.result}
+
     def Kill(self, name, sig):
         request = rpc_pb2.TContainerRequest()
         request.kill.name = name
@@ -376,6 +391,20 @@ class _RPC(object):
             request.listLayers.place = place
         return self.call(request, self.timeout).layers.layer
 
+    def CollectLayers(self, place=None, dry_run=False, high_watermark=None,
+                      low_watermark=None, min_age=None):
+        request = rpc_pb2.TContainerRequest()
+        request.collectLayers.dry_run = dry_run
+        if place is not None:
+            request.collectLayers.place = place
+        if high_watermark is not None:
+            request.collectLayers.high_watermark = high_watermark
+        if low_watermark is not None:
+            request.collectLayers.low_watermark = low_watermark
+        if min_age is not None:
+            request.collectLayers.min_age = min_age
+        return self.call(request, self.timeout).layers.layer
+
     def Version(self):
         request = rpc_pb2.TContainerRequest()
         request.version.CopyFrom(rpc_pb2.TVersionRequest())
@@ -532,6 +561,12 @@ class Connection(object):
     def Stop(self, name, timeout=None):
         self.rpc.Stop(name, timeout)
 
+    def StartBulk(self, names=[], subtree=None, state=None, threads=None):
+        return self.rpc.Bulk(names, subtree, state, False, None, threads)
+
+    def StopBulk(self, names=[], subtree=None, state=None, timeout=None, threads=None):
+        return self.rpc.Bulk(names, subtree, state, True, timeout, threads)
+
     def Kill(self, name, sig):
         self.rpc.Kill(name, sig)
 
@@ -617,6 +652,11 @@ class Connection(object):
     def ListLayers(self, place=None):
         return [Layer(self.rpc, l) for l in self.rpc.ListLayers(place)]
 
+    def CollectLayers(self, place=None, dry_run=False, high_watermark=None,
+                      low_watermark=None, min_age=None):
+        return self.rpc.CollectLayers(place, dry_run, high_watermark,
+                                      low_watermark, min_age)
+
     def ConvertPath(self, path, source, destination):
         return self.rpc.ConvertPath(self.rpc, path, source, destination)
 
@@ -1,6 +1,8 @@
 #include <algorithm>
 #include <cmath>
 #include <csignal>
+#include <mutex>
+#include <map>
 
 #include "cgroup.hpp"
 #include "device.hpp"
@@ -8,11 +10,15 @@
 #include "util/log.hpp"
 #include "util/string.hpp"
 #include "util/unix.hpp"
+#include "util/worker.hpp"
+#include "statistics.hpp"
 
 extern "C" {
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/eventfd.h>
+#include <sys/inotify.h>
+#include <poll.h>
 }
 
 const TFlagsNames ControllersName = {
@@ -26,6 +32,12 @@ const TFlagsNames ControllersName = {
     { CGROUP_LEGACY,    "legacy" },
 };
 
+bool CgroupV2 = false;
+uint64_t SupportedControllers = 0;
+
+/* Controllers enabled for childs in cgroup v2, like "+cpu +memory" */
+static std::string SubtreeControl;
+
 TPath TCgroup::Path() const {
     if (!Subsystem)
         return TPath();
@@ -48,6 +60,24 @@ bool TCgroup::Exists() const {
     return Path().IsDirectoryStrict();
 }
 
+static bool IsContainerCgroup(const std::string &name) {
+    std::string prefix(PORTO_CGROUP_PREFIX);
+    return name.size() > prefix.size() && StringStartsWith(name, prefix) &&
+        (name[prefix.size()] == '/' || name[prefix.size()] == '%') &&
+        !StringEndsWith(name, std::string("/") + PORTO_CGROUP_LEAF);
+}
+
+/*
+ * Cgroup v2 forbids processes in cgroups with controllers enabled for
+ * childs. Container cgroup enables them for nested containers while own
+ * tasks of container including portoinit live in leaf cgroup "self".
+ */
+TCgroup TCgroup::Leaf() const {
+    if (CgroupV2 && IsContainerCgroup(Name))
+        return Child(PORTO_CGROUP_LEAF);
+    return *this;
+}
+
 TError TCgroup::Create() const {
     TError error;
 
@@ -56,8 +86,22 @@ TError TCgroup::Create() const {
 
     L_ACT() << "Create cgroup " << *this << std::endl;
     error = Path().Mkdir(0755);
-    if (error)
+    if (error) {
         L_ERR() << "Cannot create cgroup " << *this << " : " << error << std::endl;
+        return error;
+    }
+
+    /* Root gets controllers at start, container cgroups before own leaf */
+    if (CgroupV2 && (Name == PORTO_CGROUP_PREFIX || Leaf() != *this)) {
+        if (SubtreeControl.size())
+            error = Set("cgroup.subtree_control", SubtreeControl);
+        if (!error && Leaf() != *this)
+            error = Leaf().Path().Mkdir(0755);
+        if (error) {
+            L_ERR() << "Cannot create cgroup " << *this << " : " << error << std::endl;
+            (void)Path().Rmdir();
+        }
+    }
 
     return error;
 }
@@ -69,6 +113,12 @@ TError TCgroup::Remove() const {
     if (Secondary())
         return TError(EError::Unknown, "Cannot create secondary cgroup " + Type());
 
+    if (Leaf() != *this) {
+        error = Leaf().Remove();
+        if (error && error.GetErrno() != ENOENT)
+            return error;
+    }
+
     L_ACT() << "Remove cgroup " << *this << std::endl;
     error = Path().Rmdir();
 
@@ -89,6 +139,20 @@ TError TCgroup::Remove() const {
     return error;
 }
 
+TError TCgroup::Rename(const TCgroup &target) const {
+    TError error;
+
+    if (Secondary())
+        return TError(EError::Unknown, "Cannot rename secondary cgroup " + Type());
+
+    L_ACT() << "Rename cgroup " << *this << " to " << target.Name << std::endl;
+    error = Path().Rename(target.Path());
+    if (error)
+        L_ERR() << "Cannot rename cgroup " << *this << " : " << error << std::endl;
+
+    return error;
+}
+
 bool TCgroup::Has(const std::string &knob) const {
     if (!Subsystem)
         return false;
@@ -157,7 +221,7 @@ TError TCgroup::Attach(pid_t pid) const {
         return TError(EError::Unknown, "Cannot attach to secondary cgroup " + Type());
 
     L_ACT() << "Attach process " << pid << " to " << *this << std::endl;
-    TError error = Knob("cgroup.procs").WriteAll(std::to_string(pid));
+    TError error = Leaf().Knob("cgroup.procs").WriteAll(std::to_string(pid));
     if (error)
         L_ERR() << "Cannot attach process " << pid << " to " << *this << " : " << error << std::endl;
 
@@ -181,6 +245,8 @@ TError TCgroup::Childs(std::vector<TCgroup> &cgroups) const {
     for (auto &name : subdirs) {
         if (IsRoot() && !StringStartsWith(name, PORTO_CGROUP_PREFIX + 1))
             continue;
+        if (Leaf() != *this && name == PORTO_CGROUP_LEAF)
+            continue;
         cgroups.push_back(Child(name));
     }
     return TError::Success();
@@ -213,7 +279,7 @@ TError TCgroup::GetPids(const std::string &knob, std::vector<pid_t> &pids) const
     if (!Subsystem)
         return TError(EError::Unknown, "Cannot get from null cgroup");
 
-    file = fopen(Knob(knob).c_str(), "r");;
+    file = fopen(Leaf().Knob(knob).c_str(), "r");
     if (!file)
         return TError(EError::Unknown, errno, "Cannot open knob " + knob);
     while (fscanf(file, "%d", &pid) == 1)
@@ -239,7 +305,12 @@ TError TCgroup::KillAll(int signal) const {
     if (IsRoot())
         return TError(EError::Permission, "Bad idea");
 
-    error = GetTasks(tasks);
+    /* Kills whole subtree at once, since linux 5.14 */
+    if (CgroupV2 && signal == SIGKILL && Has("cgroup.kill"))
+        return Set("cgroup.kill", "1");
+
+    /* Signal is delivered to thread group, no need to walk threads */
+    error = GetProcesses(tasks);
     if (!error) {
         for (const auto &pid : tasks) {
             if (kill(pid, signal) && errno != ESRCH) {
@@ -252,6 +323,75 @@ TError TCgroup::KillAll(int signal) const {
     return error;
 }
 
+/*
+ * Wait until all processes exit. Polls pidfds instead of sleeping, up to
+ * POLL_MAX processes at once. Signal is resent to survivors through pidfd
+ * after checking their cgroup thus cannot hit reused pid. Without pidfd
+ * falls back to polling cgroup.
+ */
+TError TCgroup::WaitEmpty(uint64_t deadline, int signal) const {
+    constexpr size_t POLL_MAX = 1024;
+    TError error;
+
+    while (true) {
+        std::vector<pid_t> pids;
+        std::vector<struct pollfd> fds;
+
+        error = GetProcesses(pids);
+        if (error || pids.empty())
+            return error;
+
+        for (auto pid: pids) {
+            int fd = PidfdOpen(pid);
+            if (fd < 0) {
+                if (errno != ESRCH)
+                    break;
+                continue;
+            }
+            /* Pidfd pins process: check it is still ours before signal */
+            TCgroup cg;
+            if (Subsystem->TaskCgroup(pid, cg) || cg != *this) {
+                close(fd);
+                continue;
+            }
+            if (signal && PidfdSendSignal(fd, signal) && errno != ESRCH)
+                L_WRN() << "Cannot kill process " << pid << " : " << strerror(errno) << std::endl;
+            fds.push_back({fd, POLLIN, 0});
+            if (fds.size() >= POLL_MAX)
+                break;
+        }
+
+        if (fds.empty() && pids.size()) {
+            if (WaitDeadline(deadline))
+                break;
+            continue;
+        }
+
+        size_t alive = fds.size();
+        while (alive) {
+            int64_t timeout = deadline ? int64_t(deadline - GetCurrentTimeMs()) : 0;
+            int ret = poll(fds.data(), fds.size(), std::max(timeout, (int64_t)0));
+            if (ret <= 0)
+                break;
+            for (auto &pfd: fds) {
+                if (pfd.fd >= 0 && pfd.revents) {
+                    close(pfd.fd);
+                    pfd.fd = -1;
+                    alive--;
+                }
+            }
+        }
+
+        for (auto &pfd: fds)
+            if (pfd.fd >= 0)
+                close(pfd.fd);
+
+        if (alive && WaitDeadline(deadline, 0))
+            break;
+    }
+
+    return TError(EError::Busy, "Cgroup " + Name + " still has processes");
+}
 
 TCgroup TSubsystem::RootCgroup() const {
     return TCgroup(this, "/");
@@ -263,37 +403,60 @@ TCgroup TSubsystem::Cgroup(const std::string &name) const {
 }
 
 TError TSubsystem::TaskCgroup(pid_t pid, TCgroup &cgroup) const {
-    FILE *file = fopen(("/proc/" + std::to_string(pid) + "/cgroup").c_str(), "r");
+    std::map<const TSubsystem *, TCgroup> cgroups;
+    TError error;
+
+    error = TaskCgroups(pid, cgroups);
+    if (error)
+        return error;
 
-    if (file) {
-        int id;
+    auto it = cgroups.find(Hierarchy);
+    if (it == cgroups.end())
+        return TError(EError::Unknown, "Cannot find " + Type +
+                      " cgroup for process " + std::to_string(pid));
 
-        while (fscanf(file, "%d:", &id) == 1) {
-            bool found = false;
-            char *ss, *cg;
+    cgroup = TCgroup(this, it->second.Name);
+    return TError::Success();
+}
 
-            while (fscanf(file, "%m[^:,],", &ss) == 1) {
-                if (std::string(ss) == Type)
-                    found = true;
-                free(ss);
-            }
+/* Parse /proc/pid/cgroup once for all hierarchies */
+TError TaskCgroups(pid_t pid, std::map<const TSubsystem *, TCgroup> &cgroups) {
+    std::vector<std::string> lines;
+    TError error;
 
-            if (fscanf(file, ":%ms\n", &cg) == 1) {
-                if (found) {
-                    cgroup.Subsystem = this;
-                    cgroup.Name = std::string(cg);
-                    free(cg);
-                    fclose(file);
-                    return TError::Success();
-                }
-                free(cg);
+    error = TPath("/proc/" + std::to_string(pid) + "/cgroup").ReadLines(lines);
+    if (error)
+        return error;
+
+    for (auto &line: lines) {
+        auto sep1 = line.find(':');
+        auto sep2 = line.find(':', sep1 + 1);
+        if (sep1 == std::string::npos || sep2 == std::string::npos)
+            continue;
+
+        std::string name = line.substr(sep2 + 1);
+
+        /* Unified hierarchy is listed as "0::/path", tasks of container are in leaf */
+        if (sep2 == sep1 + 1) {
+            if (CgroupV2) {
+                TCgroup cg(&FreezerSubsystem, TPath(name).DirName().ToString());
+                if (TPath(name).BaseName() != PORTO_CGROUP_LEAF || cg.Leaf() == cg)
+                    cg.Name = name;
+                cgroups[&FreezerSubsystem] = cg;
             }
+            continue;
+        }
+
+        std::vector<std::string> types;
+        (void)SplitString(line.substr(sep1 + 1, sep2 - sep1 - 1), ',', types);
+
+        for (auto hy: Hierarchies) {
+            if (std::find(types.begin(), types.end(), hy->Type) != types.end())
+                cgroups[hy] = TCgroup(hy, name);
         }
-        fclose(file);
     }
 
-    return TError(EError::Unknown, errno, "Cannot find " + Type +
-                    " cgroup for process " + std::to_string(pid));
+    return TError::Success();
 }
 
 // Memory
@@ -301,6 +464,9 @@ TError TMemorySubsystem::SetLimit(TCgroup &cg, uint64_t limit) {
     uint64_t old_limit, cur_limit, new_limit;
     TError error;
 
+    if (CgroupV2)
+        return cg.Set(MAX, limit ? std::to_string(limit) : "max");
+
     /*
      * Maxumum value depends on arch, kernel version and bugs
      * "-1" works everywhere since 2.6.31
@@ -350,6 +516,39 @@ TError TMemorySubsystem::SetLimit(TCgroup &cg, uint64_t limit) {
     return error;
 }
 
+/* For cgroup v2 also provide hierarchical counters under v1 names */
+TError TMemorySubsystem::Statistics(TCgroup &cg, TUintMap &stat) const {
+    static const std::vector<std::pair<std::string, std::string>> v1names = {
+        { "anon",           "total_rss" },
+        { "file",           "total_cache" },
+        { "file_mapped",    "total_mapped_file" },
+        { "file_dirty",     "total_dirty" },
+        { "file_writeback", "total_writeback" },
+        { "shmem",          "total_shmem" },
+        { "active_anon",    "total_active_anon" },
+        { "inactive_anon",  "total_inactive_anon" },
+        { "active_file",    "total_active_file" },
+        { "inactive_file",  "total_inactive_file" },
+        { "unevictable",    "total_unevictable" },
+        { "pgfault",        "total_pgfault" },
+        { "pgmajfault",     "total_pgmajfault" },
+    };
+    TError error;
+
+    error = cg.GetUintMap(STAT, stat);
+    if (error || !CgroupV2)
+        return error;
+
+    for (auto &it: v1names)
+        stat[it.second] = stat[it.first];
+
+    uint64_t swap;
+    if (!cg.GetUint64(SWAP_CURRENT, swap))
+        stat["total_swap"] = swap;
+
+    return TError::Success();
+}
+
 TError TMemorySubsystem::GetAnonUsage(TCgroup &cg, uint64_t &usage) const {
     if (cg.Has(ANON_USAGE))
         return cg.GetUint64(ANON_USAGE, usage);
@@ -394,10 +593,44 @@ TError TMemorySubsystem::SetDirtyLimit(TCgroup &cg, uint64_t limit) {
     return cg.SetUint64(DIRTY_RATIO, 50);
 }
 
+TError TMemorySubsystem::GetFailCnt(TCgroup &cg, uint64_t &cnt) {
+    if (CgroupV2) {
+        TUintMap events;
+        TError error = cg.GetUintMap(EVENTS_LOCAL, events);
+        cnt = events["max"];
+        return error;
+    }
+    return cg.GetUint64(FAIL_CNT, cnt);
+}
+
+/*
+ * Cgroup v2: times when limit of this cgroup was hit. Counters in
+ * memory.events are hierarchical and oom_kill also counts global OOM.
+ */
+TError TMemorySubsystem::GetOomEvents(TCgroup &cg, uint64_t &cnt) {
+    TUintMap events;
+    TError error = cg.GetUintMap(EVENTS_LOCAL, events);
+    cnt = events["oom"];
+    return error;
+}
+
+/* In cgroup v2 event is inotify for any change in memory.events.local */
 TError TMemorySubsystem::SetupOOMEvent(TCgroup &cg, TFile &event) {
     TError error;
     TFile knob;
 
+    if (CgroupV2) {
+        event.Close();
+        event.SetFd = inotify_init1(IN_CLOEXEC | IN_NONBLOCK);
+        if (event.Fd < 0)
+            return TError(EError::Unknown, errno, "Cannot create inotify");
+        if (inotify_add_watch(event.Fd, cg.Knob(EVENTS_LOCAL).c_str(), IN_MODIFY) < 0) {
+            error = TError(EError::Unknown, errno, "Cannot watch " + EVENTS_LOCAL);
+            event.Close();
+        }
+        return error;
+    }
+
     error = knob.OpenRead(cg.Knob(OOM_CONTROL));
     if (error)
         return error;
@@ -414,32 +647,91 @@ TError TMemorySubsystem::SetupOOMEvent(TCgroup &cg, TFile &event) {
 }
 
 // Freezer
+/* cgroup v2 state is reported as "FROZEN" or "THAWED" too */
+TError TFreezerSubsystem::GetState(TCgroup &cg, std::string &state) const {
+    if (CgroupV2) {
+        TUintMap events;
+        TError error = cg.GetUintMap("cgroup.events", events);
+        if (!error)
+            state = events["frozen"] ? "FROZEN" : "THAWED";
+        return error;
+    }
+
+    TError error = cg.Get("freezer.state", state);
+    if (!error)
+        state = StringTrim(state);
+    return error;
+}
+
+/*
+ * Cgroup v2 notifies about changes in cgroup.events: poll reports POLLPRI
+ * after each change since last read. Freezer v1 has no notifications,
+ * there state is polled with exponential backoff from 100us up to 10ms:
+ * small cgroups are done in microseconds, large ones cost few wakeups.
+ * Pause, stop and destroy requests wait in event worker, see rpc.cpp.
+ */
 TError TFreezerSubsystem::WaitState(TCgroup &cg, const std::string &state) const {
     uint64_t deadline = GetCurrentTimeMs() + config().daemon().freezer_wait_timeout_s() * 1000;
+    uint64_t backoff = 100;
     std::string cur;
     TError error;
 
-    do {
-        error = cg.Get("freezer.state", cur);
-        if (error || StringTrim(cur) == state)
+    if (CgroupV2) {
+        TFile events;
+        std::string text;
+
+        error = events.OpenRead(cg.Knob("cgroup.events"));
+        if (error)
             return error;
-    } while (!WaitDeadline(deadline));
+
+        while (true) {
+            if (lseek(events.Fd, 0, SEEK_SET) < 0)
+                return TError(EError::Unknown, errno, "lseek");
+            error = events.ReadAll(text, 4096);
+            if (error)
+                return error;
+            bool frozen = text.find("frozen 1") != std::string::npos;
+            if (frozen == (state == "FROZEN"))
+                return TError::Success();
+
+            int64_t timeout = deadline - GetCurrentTimeMs();
+            if (timeout <= 0)
+                break;
+            struct pollfd pfd = { events.Fd, POLLPRI, 0 };
+            if (poll(&pfd, 1, timeout) < 0 && errno != EINTR)
+                return TError(EError::Unknown, errno, "poll");
+        }
+    } else {
+        while (true) {
+            error = GetState(cg, cur);
+            if (error || cur == state)
+                return error;
+
+            int64_t timeout = (deadline - GetCurrentTimeMs()) * 1000;
+            if (timeout <= 0)
+                break;
+            usleep(std::min((int64_t)backoff, timeout));
+            backoff = std::min(backoff * 2, (uint64_t)10000);
+        }
+    }
 
     return TError(EError::Unknown, "Freezer " + cg.Name + " timeout waiting " + state);
 }
 
-TError TFreezerSubsystem::Freeze(TCgroup &cg) const {
-    TError error = cg.Set("freezer.state", "FROZEN");
-    if (error)
+TError TFreezerSubsystem::Freeze(TCgroup &cg, bool wait) const {
+    TError error = CgroupV2 ? cg.SetBool("cgroup.freeze", true) :
+                              cg.Set("freezer.state", "FROZEN");
+    if (error || !wait)
         return error;
     error = WaitState(cg, "FROZEN");
     if (error)
-        (void)cg.Set("freezer.state", "THAWED");
+        (void)Thaw(cg, false);
     return error;
 }
 
 TError TFreezerSubsystem::Thaw(TCgroup &cg, bool wait) const {
-    TError error = cg.Set("freezer.state", "THAWED");
+    TError error = CgroupV2 ? cg.SetBool("cgroup.freeze", false) :
+                              cg.Set("freezer.state", "THAWED");
     if (error || !wait)
         return error;
     if (IsParentFreezing(cg))
@@ -449,16 +741,28 @@ TError TFreezerSubsystem::Thaw(TCgroup &cg, bool wait) const {
 
 bool TFreezerSubsystem::IsFrozen(TCgroup &cg) const {
     std::string state;
-    return !cg.Get("freezer.state", state) && StringTrim(state) != "THAWED";
+    if (CgroupV2)
+        return IsSelfFreezing(cg) || (!GetState(cg, state) && state != "THAWED");
+    return !GetState(cg, state) && state != "THAWED";
 }
 
 bool TFreezerSubsystem::IsSelfFreezing(TCgroup &cg) const {
     bool val;
-    return !cg.GetBool("freezer.self_freezing", val) && val;
+    return !cg.GetBool(CgroupV2 ? "cgroup.freeze" : "freezer.self_freezing", val) && val;
 }
 
 bool TFreezerSubsystem::IsParentFreezing(TCgroup &cg) const {
     bool val;
+
+    if (CgroupV2) {
+        for (TPath path = TPath(cg.Name).DirName(); !path.IsRoot(); path = path.DirName()) {
+            TCgroup parent(this, path.ToString());
+            if (IsSelfFreezing(parent))
+                return true;
+        }
+        return false;
+    }
+
     return !cg.GetBool("freezer.parent_freezing", val) && val;
 }
 
@@ -466,6 +770,16 @@ bool TFreezerSubsystem::IsParentFreezing(TCgroup &cg) const {
 void TCpuSubsystem::InitializeSubsystem() {
     TCgroup cg = RootCgroup();
 
+    /* cpu.weight and cpu.max, root cgroup has none of them */
+    if (CgroupV2) {
+        HasShares = HasQuota = true;
+        HasReserve = HasSmart = false;
+        BaseShares = 1024;
+        BasePeriod = 100000;
+        L_SYS() << GetNumCores() << " cores" << std::endl;
+        return;
+    }
+
     HasShares = cg.Has("cpu.shares");
     if (HasShares && cg.GetUint64("cpu.shares", BaseShares))
         BaseShares = 1024;
@@ -506,11 +820,28 @@ TError TCpuSubsystem::SetCpuPolicy(TCgroup &cg, const std::string &policy,
         if (limit >= GetNumCores())
             quota = -1;
 
-        error = cg.Set("cpu.cfs_quota_us", std::to_string(quota));
+        if (CgroupV2)
+            error = cg.Set("cpu.max", (quota < 0 ? "max" : std::to_string(quota)) +
+                           " " + std::to_string(BasePeriod));
+        else
+            error = cg.Set("cpu.cfs_quota_us", std::to_string(quota));
         if (error)
             return error;
     }
 
+    if (CgroupV2) {
+        uint64_t shares = std::floor((guarantee + 1) * BaseShares);
+
+        if (policy == "rt")
+            shares *= 16;
+        else if (policy == "idle")
+            shares /= 16;
+
+        /* Same conversion as in systemd and runc: [2..262144] -> [1..10000] */
+        shares = std::min(std::max(shares, (uint64_t)2), (uint64_t)262144);
+        return cg.SetUint64("cpu.weight", 1 + ((shares - 2) * 9999) / 262142);
+    }
+
     if (HasReserve) {
         uint64_t reserve = std::floor(guarantee * BasePeriod);
         uint64_t shares = BaseShares, reserve_shares = BaseShares;
@@ -561,6 +892,13 @@ TError TCpuSubsystem::SetCpuPolicy(TCgroup &cg, const std::string &policy,
 
 // Cpuacct
 TError TCpuacctSubsystem::Usage(TCgroup &cg, uint64_t &value) const {
+    if (CgroupV2) {
+        TUintMap stat;
+        TError error = cg.GetUintMap("cpu.stat", stat);
+        value = stat["usage_usec"] * 1000;
+        return error;
+    }
+
     std::string s;
     TError error = cg.Get("cpuacct.usage", s);
     if (error)
@@ -570,6 +908,13 @@ TError TCpuacctSubsystem::Usage(TCgroup &cg, uint64_t &value) const {
 
 TError TCpuacctSubsystem::SystemUsage(TCgroup &cg, uint64_t &value) const {
     TUintMap stat;
+
+    if (CgroupV2) {
+        TError error = cg.GetUintMap("cpu.stat", stat);
+        value = stat["system_usec"] * 1000;
+        return error;
+    }
+
     TError error = cg.GetUintMap("cpuacct.stat", stat);
     if (error)
         return error;
@@ -605,9 +950,51 @@ TError TBlkioSubsystem::GetDevice(const std::string &majmin,
     return error;
 }
 
+/* cgroup v2 io.stat: "8:0 rbytes=1 wbytes=2 rios=3 wios=4 dbytes=5 dios=6" */
+TError TBlkioSubsystem::StatisticsV2(TCgroup &cg, bool ops,
+                                     std::vector<BlkioStat> &stat) const {
+    std::vector<std::string> lines;
+    TError error = cg.Knob("io.stat").ReadLines(lines);
+    if (error)
+        return error;
+
+    for (auto &line: lines) {
+        std::vector<std::string> tokens;
+        BlkioStat s = {};
+
+        error = SplitString(line, ' ', tokens);
+        if (error || tokens.size() < 2)
+            continue;
+
+        error = GetDevice(tokens[0], s.Device);
+        if (error)
+            return error;
+
+        for (size_t i = 1; i < tokens.size(); i++) {
+            auto sep = tokens[i].find('=');
+            uint64_t val;
+            if (sep == std::string::npos ||
+                    StringToUint64(tokens[i].substr(sep + 1), val))
+                continue;
+            auto key = tokens[i].substr(0, sep);
+            if (key == (ops ? "rios" : "rbytes"))
+                s.Read = val;
+            else if (key == (ops ? "wios" : "wbytes"))
+                s.Write = val;
+        }
+
+        stat.push_back(s);
+    }
+
+    return TError::Success();
+}
+
 TError TBlkioSubsystem::Statistics(TCgroup &cg,
                                    const std::string &file,
                                    std::vector<BlkioStat> &stat) const {
+    if (CgroupV2)
+        return StatisticsV2(cg, file.find("serviced") != std::string::npos, stat);
+
     std::vector<std::string> lines;
     TError error = cg.Knob(file).ReadLines(lines);
     if (error)
@@ -659,11 +1046,18 @@ TError TBlkioSubsystem::SetIoPolicy(TCgroup &cg, const std::string &policy) cons
     else
         return TError(EError::InvalidValue, "unknown policy: " + policy);
 
+    /* Same conversion as in systemd: [10..1000] -> [1..10000] */
+    if (CgroupV2) {
+        weight = std::min(std::max(weight, (uint64_t)10), (uint64_t)1000);
+        return cg.Set("io.weight", "default " +
+                      std::to_string(1 + (weight - 10) * 9999 / 990));
+    }
+
     return cg.SetUint64("blkio.weight", weight);
 }
 
 bool TBlkioSubsystem::SupportIoPolicy() const {
-    return RootCgroup().Has("blkio.weight");
+    return CgroupV2 || RootCgroup().Has("blkio.weight");
 }
 
 // Devices
@@ -730,6 +1124,68 @@ std::vector<TSubsystem *> Subsystems;
 std::vector<TSubsystem *> Hierarchies;
 
 
+/*
+ * All controllers are bound to freezer hierarchy. Net_cls and devices
+ * have no cgroup v2 counterparts and are not supported.
+ */
+static TError InitializeUnifiedCgroups(const TPath &root) {
+    static const std::map<TSubsystem *, std::string> v2names = {
+        { &FreezerSubsystem, "" },
+        { &MemorySubsystem,  "memory" },
+        { &CpuSubsystem,     "cpu" },
+        { &CpuacctSubsystem, "" },
+        { &BlkioSubsystem,   "io" },
+    };
+    std::vector<std::string> available;
+    std::string controllers;
+    TError error;
+
+    L_SYS() << "Use cgroup v2 unified hierarchy at " << root << std::endl;
+
+    CgroupV2 = true;
+    SupportedControllers = CGROUP_LEGACY;
+
+    error = (root / "cgroup.controllers").ReadAll(controllers);
+    if (error)
+        return error;
+    SplitString(StringTrim(controllers), ' ', available);
+
+    for (auto subsys: AllSubsystems) {
+        auto it = v2names.find(subsys);
+        if (it == v2names.end()) {
+            L() << "Cgroup subsystem " << subsys->Type << " is not supported" << std::endl;
+            continue;
+        }
+
+        if (it->second.size()) {
+            if (std::find(available.begin(), available.end(), it->second) == available.end())
+                return TError(EError::NotSupported, "Cgroup controller " + it->second + " is not available");
+            if (SubtreeControl.size())
+                SubtreeControl += " ";
+            SubtreeControl += "+" + it->second;
+        }
+
+        subsys->Root = root;
+        subsys->Hierarchy = &FreezerSubsystem;
+        FreezerSubsystem.Controllers |= subsys->Kind;
+        SupportedControllers |= subsys->Kind;
+        Subsystems.push_back(subsys);
+    }
+
+    Hierarchies.push_back(&FreezerSubsystem);
+
+    for (auto subsys: Subsystems) {
+        subsys->Controllers = FreezerSubsystem.Controllers;
+        subsys->InitializeSubsystem();
+    }
+
+    error = FreezerSubsystem.RootCgroup().Set("cgroup.subtree_control", SubtreeControl);
+    if (error)
+        L_ERR() << "Cannot enable cgroup controllers: " << error << std::endl;
+
+    return error;
+}
+
 TError InitializeCgroups() {
     TPath root(config().daemon().sysfs_root());
     std::list<TMount> mounts;
@@ -742,6 +1198,9 @@ TError InitializeCgroups() {
         return error;
     }
 
+    if (mount.Target == root && mount.Type == "cgroup2")
+        return InitializeUnifiedCgroups(root);
+
     if (mount.Target != root) {
         error = root.Mount("cgroup", "tmpfs", 0, {});
         if (error) {
@@ -813,6 +1272,8 @@ TError InitializeCgroups() {
     for (auto subsys: AllSubsystems)
         subsys->Controllers |= subsys->Hierarchy->Controllers;
 
+    SupportedControllers = ~0ull;
+
     return error;
 }
 
@@ -865,3 +1326,242 @@ TError InitializeDaemonCgroups() {
 
     return TError::Success();
 }
+
+/*
+ * Cgroup pool keeps anonymous pre-configured cgroups directly under root
+ * of each hierarchy. First-level containers take them by rename at start
+ * and give them back by rename at stop. Worker resets released cgroups
+ * which carry no accounting and puts them back into pool, others are
+ * removed in background: mkdir and rmdir are off the start/stop path.
+ *
+ * Names contain '#' which is forbidden in container names.
+ */
+
+#define CGROUP_POOL_PREFIX  "/porto#pool-"
+#define CGROUP_DEAD_PREFIX  "/porto#dead-"
+
+/* Controllers without counters that could be reset for next user */
+constexpr uint64_t CGROUP_RECYCLABLE = CGROUP_FREEZER | CGROUP_NETCLS | CGROUP_DEVICES;
+
+static std::mutex CgroupPoolMutex;
+static std::map<const TSubsystem *, std::vector<TCgroup>> CgroupPool;
+static std::vector<TCgroup> CgroupDead;
+static uint64_t CgroupPoolSeq = 0;
+static bool CgroupPoolEnabled = false;
+
+static bool CgroupPoolable(const TCgroup &cg) {
+    return !cg.Secondary() && cg.Name.find('/', 1) == std::string::npos;
+}
+
+/* Pooled cgroup looks like freshly created for first-level container */
+static TError ResetPooledCgroup(TCgroup &cg) {
+    uint64_t controllers = cg.Subsystem->Controllers;
+    TError error;
+
+    if (controllers & CGROUP_FREEZER) {
+        if (FreezerSubsystem.IsFrozen(cg)) {
+            error = FreezerSubsystem.Thaw(cg);
+            if (error)
+                return error;
+        }
+    }
+
+    if ((controllers & CGROUP_MEMORY) && !CgroupV2) {
+        error = cg.SetBool(MemorySubsystem.USE_HIERARCHY, true);
+        if (error)
+            return error;
+    }
+
+    if (controllers & CGROUP_NETCLS) {
+        error = cg.Set("net_cls.classid", "0");
+        if (error)
+            return error;
+    }
+
+    if (controllers & CGROUP_DEVICES) {
+        error = DevicesSubsystem.ApplyDefault(cg);
+        if (error)
+            return error;
+    }
+
+    return TError::Success();
+}
+
+static bool RecycleCgroup(TCgroup &cg) {
+    TError error;
+
+    if (cg.Subsystem->Controllers & ~CGROUP_RECYCLABLE)
+        return false;
+
+    if (!cg.IsEmpty())
+        return false;
+
+    std::unique_lock<std::mutex> lock(CgroupPoolMutex);
+    auto &pool = CgroupPool[cg.Subsystem];
+    if (pool.size() >= config().daemon().cgroup_pool_size())
+        return false;
+    TCgroup ready = cg.Subsystem->Cgroup(CGROUP_POOL_PREFIX +
+                                         std::to_string(++CgroupPoolSeq));
+    lock.unlock();
+
+    error = ResetPooledCgroup(cg);
+    if (!error)
+        error = cg.Rename(ready);
+    if (error) {
+        L_WRN() << "Cannot recycle cgroup " << cg << " : " << error << std::endl;
+        return false;
+    }
+
+    lock.lock();
+    pool.push_back(ready);
+    Statistics->CgroupsRecycled++;
+
+    return true;
+}
+
+/* Refill from half: stopped containers return recyclable cgroups back */
+static void RefillCgroupPool() {
+    TError error;
+
+    for (auto hy: Hierarchies) {
+        std::unique_lock<std::mutex> lock(CgroupPoolMutex);
+        auto &pool = CgroupPool[hy];
+        if (pool.size() > config().daemon().cgroup_pool_size() / 2)
+            continue;
+        while (pool.size() < config().daemon().cgroup_pool_size()) {
+            TCgroup cg = hy->Cgroup(CGROUP_POOL_PREFIX +
+                                    std::to_string(++CgroupPoolSeq));
+            lock.unlock();
+
+            error = cg.Create();
+            if (!error) {
+                error = ResetPooledCgroup(cg);
+                if (error)
+                    (void)cg.Remove();
+            }
+
+            lock.lock();
+            if (error) {
+                L_WRN() << "Cannot refill cgroup pool: " << error << std::endl;
+                break;
+            }
+            pool.push_back(cg);
+        }
+    }
+}
+
+class TCgroupPoolWorker : public TWorker<int> {
+public:
+    TCgroupPoolWorker() : TWorker("portod-cg-pool", 1) {}
+
+    void Wait(TScopedLock &lock) override {
+        if (Valid)
+            Cv.wait_for(lock, std::chrono::milliseconds(
+                        config().daemon().cgroup_pool_interval_ms()));
+    }
+
+    /* Wakeup worker without queueing another request */
+    void Kick() {
+        auto lock = ScopedLock();
+        Seq++;
+        Cv.notify_one();
+    }
+
+    const int &Top() override {
+        return Queue.front();
+    }
+
+    /* Never completes: requeued and handled again after timeout or kick */
+    bool Handle(const int &) override {
+        std::unique_lock<std::mutex> lock(CgroupPoolMutex);
+        auto dead = std::move(CgroupDead);
+        CgroupDead.clear();
+        lock.unlock();
+
+        for (auto &cg: dead) {
+            if (!RecycleCgroup(cg))
+                (void)cg.Remove(); //Logged inside
+        }
+
+        RefillCgroupPool();
+
+        return false;
+    }
+};
+
+static TCgroupPoolWorker CgroupPoolWorker;
+
+TError TakePooledCgroup(const TCgroup &cg) {
+    TError error;
+
+    if (!CgroupPoolable(cg))
+        return TError(EError::NotSupported, "Cgroup " + cg.Name + " cannot be pooled");
+
+    std::unique_lock<std::mutex> lock(CgroupPoolMutex);
+    if (!CgroupPoolEnabled)
+        return TError(EError::NotSupported, "Cgroup pool disabled");
+    auto &pool = CgroupPool[cg.Subsystem];
+    if (pool.empty())
+        return TError(EError::ResourceNotAvailable, "Cgroup pool is empty");
+    TCgroup ready = pool.back();
+    pool.pop_back();
+    lock.unlock();
+
+    CgroupPoolWorker.Kick();
+
+    error = ready.Rename(cg);
+    if (error) {
+        lock.lock();
+        CgroupDead.push_back(ready);
+        return error;
+    }
+
+    Statistics->CgroupsPooled++;
+
+    return TError::Success();
+}
+
+TError ReleaseCgroup(const TCgroup &cg) {
+    TError error;
+
+    std::unique_lock<std::mutex> lock(CgroupPoolMutex);
+    if (!CgroupPoolEnabled || !CgroupPoolable(cg))
+        return cg.Remove();
+    TCgroup dead = cg.Subsystem->Cgroup(CGROUP_DEAD_PREFIX +
+                                        std::to_string(++CgroupPoolSeq));
+    lock.unlock();
+
+    if (!cg.IsEmpty())
+        return cg.Remove();
+
+    error = cg.Rename(dead);
+    if (error)
+        return cg.Remove();
+
+    lock.lock();
+    CgroupDead.push_back(dead);
+    lock.unlock();
+
+    CgroupPoolWorker.Kick();
+
+    return TError::Success();
+}
+
+void StartCgroupPool() {
+    /* cgroup v2 does not support rename */
+    if (!config().daemon().cgroup_pool_size() || CgroupV2)
+        return;
+    std::unique_lock<std::mutex> lock(CgroupPoolMutex);
+    CgroupPoolEnabled = true;
+    lock.unlock();
+    CgroupPoolWorker.Push(0);
+    CgroupPoolWorker.Start();
+}
+
+/* Leftovers are removed by cgroup cleanup at next start */
+void StopCgroupPool() {
+    std::unique_lock<std::mutex> lock(CgroupPoolMutex);
+    CgroupPoolEnabled = false;
+    lock.unlock();
+    CgroupPoolWorker.Stop();
+}
@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <map>
 
 #include "common.hpp"
 #include "util/path.hpp"
@@ -19,6 +20,10 @@ class TCgroup;
 
 extern const TFlagsNames ControllersName;
 
+/* Unified hierarchy: all controllers in one tree, cgroup v2 interface */
+extern bool CgroupV2;
+extern uint64_t SupportedControllers;
+
 class TSubsystem {
 public:
     const uint64_t Kind;
@@ -72,18 +77,21 @@ public:
     TPath Path() const;
     bool IsRoot() const;
     bool Exists() const;
+    TCgroup Leaf() const;
 
     TError Create() const;
     TError Remove() const;
+    TError Rename(const TCgroup &target) const;
 
     TError KillAll(int signal) const;
+    TError WaitEmpty(uint64_t deadline, int signal = 0) const;
 
     TError GetProcesses(std::vector<pid_t> &pids) const {
         return GetPids("cgroup.procs", pids);
     }
 
     TError GetTasks(std::vector<pid_t> &pids) const {
-        return GetPids("tasks", pids);
+        return GetPids(CgroupV2 ? "cgroup.threads" : "tasks", pids);
     }
 
     bool IsEmpty() const;
@@ -126,14 +134,24 @@ public:
     const std::string ANON_LIMIT = "memory.anon.limit";
     const std::string FAIL_CNT = "memory.failcnt";
 
+    /* cgroup v2 */
+    const std::string CURRENT = "memory.current";
+    const std::string MAX = "memory.max";
+    const std::string LOW = "memory.low";
+    const std::string SWAP_CURRENT = "memory.swap.current";
+    const std::string EVENTS = "memory.events";
+    const std::string EVENTS_LOCAL = "memory.events.local";
+
     TMemorySubsystem() : TSubsystem(CGROUP_MEMORY, "memory") {}
 
-    TError Statistics(TCgroup &cg, TUintMap &stat) const {
-        return cg.GetUintMap(STAT, stat);
-    }
+    TError Statistics(TCgroup &cg, TUintMap &stat) const;
 
     TError Usage(TCgroup &cg, uint64_t &value) const {
-        return cg.GetUint64(USAGE, value);
+        return cg.GetUint64(CgroupV2 ? CURRENT : USAGE, value);
+    }
+
+    bool SupportSoftLimit() const {
+        return !CgroupV2;
     }
 
     TError GetSoftLimit(TCgroup &cg, uint64_t &limit) const {
@@ -145,13 +163,13 @@ public:
     }
 
     bool SupportGuarantee() const {
-        return RootCgroup().Has(LOW_LIMIT);
+        return CgroupV2 || RootCgroup().Has(LOW_LIMIT);
     }
 
     TError SetGuarantee(TCgroup &cg, uint64_t guarantee) const {
         if (!SupportGuarantee())
             return TError::Success();
-        return cg.SetUint64(LOW_LIMIT, guarantee);
+        return cg.SetUint64(CgroupV2 ? LOW : LOW_LIMIT, guarantee);
     }
 
     bool SupportIoLimit() const {
@@ -186,17 +204,17 @@ public:
     TError SetDirtyLimit(TCgroup &cg, uint64_t limit);
     TError SetupOOMEvent(TCgroup &cg, TFile &event);
 
-    TError GetFailCnt(TCgroup &cg, uint64_t &cnt) {
-        return cg.GetUint64(FAIL_CNT, cnt);
-    }
+    TError GetFailCnt(TCgroup &cg, uint64_t &cnt);
+    TError GetOomEvents(TCgroup &cg, uint64_t &cnt);
 };
 
 class TFreezerSubsystem : public TSubsystem {
 public:
     TFreezerSubsystem() : TSubsystem(CGROUP_FREEZER, "freezer") {}
 
+    TError GetState(TCgroup &cg, std::string &state) const;
     TError WaitState(TCgroup &cg, const std::string &state) const;
-    TError Freeze(TCgroup &cg) const;
+    TError Freeze(TCgroup &cg, bool wait = true) const;
     TError Thaw(TCgroup &cg, bool wait = true) const;
     bool IsFrozen(TCgroup &cg) const;
     bool IsSelfFreezing(TCgroup &cg) const;
@@ -240,6 +258,8 @@ class TBlkioSubsystem : public TSubsystem {
                        uint64_t &val) const;
     TError GetDevice(const std::string &majmin,
                      std::string &device) const;
+    TError StatisticsV2(TCgroup &cg, bool ops,
+                        std::vector<BlkioStat> &stat) const;
 public:
     TBlkioSubsystem() : TSubsystem(CGROUP_BLKIO, "blkio") {}
     TError Statistics(TCgroup &cg,
@@ -269,4 +289,11 @@ extern std::vector<TSubsystem *> Subsystems;
 extern std::vector<TSubsystem *> Hierarchies;
 
 TError InitializeCgroups();
+TError TaskCgroups(pid_t pid, std::map<const TSubsystem *, TCgroup> &cgroups);
 TError InitializeDaemonCgroups();
+
+/* Pool of pre-created first-level cgroups */
+TError TakePooledCgroup(const TCgroup &cg);
+TError ReleaseCgroup(const TCgroup &cg);
+void StartCgroupPool();
+void StopCgroupPool();
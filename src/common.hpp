@@ -41,10 +41,13 @@ constexpr uint64_t NET_MAX_RATE = 2000000000; /* 16Gbit */;
 
 constexpr uint64_t ROOT_CONTAINER_ID = 1;
 constexpr uint64_t LEGACY_CONTAINER_ID = 3;
+constexpr uint64_t INGRESS_CONTAINER_ID = 0xFFFF; /* ffff: is ingress qdisc */
 
 constexpr const char *ROOT_CONTAINER = "/";
 constexpr const char *ROOT_PORTO_NAMESPACE = "/porto/";
 constexpr const char *PORTO_CGROUP_PREFIX = "/porto";
+/* Cgroup v2: leaf for own tasks of container, "self" is not valid container name */
+constexpr const char *PORTO_CGROUP_LEAF = "self";
 
 constexpr const char *DOT_CONTAINER = ".";
 constexpr const char *SELF_CONTAINER = "self";
@@ -68,7 +71,7 @@ constexpr const char *PORTO_VERSION_FILE = "/run/portod.version";
 
 constexpr uint64_t CONTAINER_NAME_MAX = 128;
 constexpr uint64_t CONTAINER_PATH_MAX = 200;
-constexpr uint64_t CONTAINER_ID_MAX = 16384;
+constexpr uint64_t CONTAINER_ID_MAX = 0xFFFF; /* 16-bit tc minor */
 constexpr uint64_t CONTAINER_LEVEL_MAX = 7;
 constexpr uint64_t RUN_SUBDIR_LIMIT = 100u;
 
@@ -43,6 +43,10 @@ void TConfig::LoadDefaults() {
     config().mutable_daemon()->set_workers(4);
     config().mutable_daemon()->set_max_msg_len(32 * 1024 * 1024);
     config().mutable_daemon()->set_event_workers(1);
+    config().mutable_daemon()->set_spawner(false);
+    config().mutable_daemon()->set_bulk_threads(8);
+    config().mutable_daemon()->set_cgroup_pool_size(8);
+    config().mutable_daemon()->set_cgroup_pool_interval_ms(1000);
 
     config().mutable_container()->set_tmp_dir("/place/porto");
     config().mutable_container()->set_chroot_porto_dir("porto");
@@ -68,6 +72,7 @@ void TConfig::LoadDefaults() {
     config().mutable_container()->set_dev_size(32 << 20);
     config().mutable_container()->set_all_controllers(false);
     config().mutable_container()->set_legacy_porto(false);
+    config().mutable_container()->set_proc_template(true);
 
     config().mutable_volumes()->mutable_keyval()->mutable_file()->set_path("/run/porto/pkvs");
 
@@ -75,6 +80,22 @@ void TConfig::LoadDefaults() {
     config().mutable_volumes()->set_volume_dir("porto_volumes");
     config().mutable_volumes()->set_layers_dir("porto_layers");
     config().mutable_volumes()->set_enable_quota(true);
+    config().mutable_volumes()->set_layer_workers(2);
+    config().mutable_volumes()->set_layer_dedup(false);
+    config().mutable_volumes()->set_objects_dir("porto_objects");
+    config().mutable_volumes()->set_junk_dir("porto_junk");
+    config().mutable_volumes()->set_reclaim_io_class(3);
+    config().mutable_volumes()->set_reclaim_rate(0);
+    config().mutable_volumes()->set_remove_threads(4);
+    config().mutable_volumes()->set_loop_templates(false);
+    config().mutable_volumes()->set_templates_dir("porto_templates");
+    config().mutable_volumes()->set_quota_threads(4);
+    config().mutable_volumes()->set_quota_workers(1);
+    config().mutable_volumes()->set_guarantee_sample_ms(5000);
+    config().mutable_volumes()->set_layer_gc_high_watermark(0);
+    config().mutable_volumes()->set_layer_gc_low_watermark(80);
+    config().mutable_volumes()->set_layer_gc_interval_ms(60000);
+    config().mutable_volumes()->set_layer_gc_min_age(3600);
 
     config().mutable_network()->set_device_qdisc("default: hfsc");
     config().mutable_network()->set_default_rate("default: 125000");    /* 1Mbit */
@@ -86,6 +107,7 @@ void TConfig::LoadDefaults() {
 
     config().mutable_network()->set_autoconf_timeout_s(120);
     config().mutable_network()->set_proxy_ndp(true);
+    config().mutable_network()->set_device_stat_cache_ms(100);
 
     // FIXME set to true and deprecate this option
     config().mutable_privileges()->set_enforce_bind_permissions(false);
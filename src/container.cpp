@@ -35,15 +35,34 @@ extern "C" {
 #include <fcntl.h>
 #include <sys/fsuid.h>
 #include <sys/stat.h>
+#include <sys/inotify.h>
+#include <limits.h>
 }
 
 std::mutex ContainersMutex;
+static std::mutex MemGuaranteeMutex;
 static std::condition_variable ContainersCV;
 std::shared_ptr<TContainer> RootContainer;
 std::map<std::string, std::shared_ptr<TContainer>> Containers;
 TPath ContainersKV;
 TIdMap ContainerIdMap(1, CONTAINER_ID_MAX);
 
+/* In order of execution, index is position in Statistics->StartStageUs */
+const std::vector<std::string> StartStages = {
+    "parent",           /* start of stopped parent */
+    "check",
+    "resources",        /* work dir, cgroups, root volume */
+    "network",
+    "properties",
+    "prepare",          /* task environment */
+    "fork",             /* till middle task reports task pid */
+    "clone",            /* till task reports vpid */
+    "middle",           /* till middle task exits */
+    "child_setup",      /* limits, mounts, namespaces in task */
+    "child_autoconf",   /* waiting for addresses */
+    "exec",             /* till task execs command */
+};
+
 TError TContainer::ValidName(const std::string &name) {
 
     if (name.length() == 0)
@@ -182,8 +201,7 @@ void TContainer::Unlock(bool locked) {
 
 void TContainer::Register() {
     Containers[Name] = shared_from_this();
-    if (Parent)
-        Parent->Children.emplace_back(shared_from_this());
+    LinkParent(true);
     Statistics->ContainersCreated++;
 }
 
@@ -240,6 +258,7 @@ TContainer::TContainer(std::shared_ptr<TContainer> parent, const std::string &na
     if (!Parent || Parent->IsRoot() || config().container().all_controllers())
         Controllers |= CGROUP_MEMORY | CGROUP_CPU | CGROUP_CPUACCT |
                        CGROUP_NETCLS | CGROUP_BLKIO | CGROUP_DEVICES;
+    Controllers &= SupportedControllers;
     SetProp(EProperty::CONTROLLERS);
 
     NetPriority["default"] = NET_DEFAULT_PRIO;
@@ -431,43 +450,47 @@ TError TContainer::GetNetStat(ENetStat kind, TUintMap &stat) {
 }
 
 void TContainer::UpdateRunningChildren(size_t diff) {
+    bool wasRunning = RunningChildren;
+
     RunningChildren += diff;
 
     if (!RunningChildren && State == EContainerState::Meta)
         NotifyWaiters();
 
+    /* meta soft limit depends only on presence of running children */
+    if (wasRunning != !!RunningChildren && State == EContainerState::Meta) {
+        TError error = UpdateSoftLimit();
+        if (error)
+            L_ERR() << "Can't update meta soft limit: " << error << std::endl;
+    }
+
     if (Parent)
         Parent->UpdateRunningChildren(diff);
 }
 
 TError TContainer::UpdateSoftLimit() {
-    if (IsRoot())
-        return TError::Success();
-
-    if (Parent)
-        Parent->UpdateSoftLimit();
+    static uint64_t defaultLimit = 0;
+    TError error;
 
-    if (State == EContainerState::Meta) {
-        uint64_t defaultLimit;
+    if (IsRoot() || !MemorySubsystem.SupportSoftLimit() ||
+            State != EContainerState::Meta)
+        return TError::Success();
 
+    if (!defaultLimit) {
         auto rootCg = MemorySubsystem.RootCgroup();
-        TError error = MemorySubsystem.GetSoftLimit(rootCg, defaultLimit);
+        error = MemorySubsystem.GetSoftLimit(rootCg, defaultLimit);
         if (error)
             return error;
+    }
 
-        uint64_t limit = RunningChildren ? defaultLimit : 1 * 1024 * 1024;
-        uint64_t currentLimit;
+    uint64_t limit = RunningChildren ? defaultLimit : 1 * 1024 * 1024;
 
+    if (MemSoftLimit != limit) {
         auto cg = GetCgroup(MemorySubsystem);
-        error = MemorySubsystem.GetSoftLimit(cg, currentLimit);
+        error = MemorySubsystem.SetSoftLimit(cg, limit);
         if (error)
             return error;
-
-        if (currentLimit != limit) {
-            error = MemorySubsystem.SetSoftLimit(cg, limit);
-            if (error)
-                return error;
-        }
+        MemSoftLimit = limit;
     }
 
     return TError::Success();
@@ -506,11 +529,15 @@ TError TContainer::Destroy() {
         child->Destroy();
     }
 
+    auto volumes_lock = LockVolumes();
     while (!Volumes.empty()) {
         std::shared_ptr<TVolume> volume = Volumes.back();
+        volumes_lock.unlock();
         if (!volume->UnlinkContainer(*this) && volume->IsDying)
             volume->Destroy();
+        volumes_lock.lock();
     }
+    volumes_lock.unlock();
 
     if (Net) {
         auto lock = Net->ScopedLock();
@@ -524,8 +551,7 @@ TError TContainer::Destroy() {
         L_WRN() << "Cannot put container id : " << error << std::endl;
 
     Containers.erase(Name);
-    if (Parent)
-        Parent->Children.remove(shared_from_this());
+    LinkParent(false);
     State = EContainerState::Destroyed;
 
     TPath path(ContainersKV / std::to_string(Id));
@@ -596,15 +622,69 @@ TError TContainer::OpenNetns(TNamespaceFd &netns) const {
     return TError(EError::InvalidValue, "Cannot open netns: container not running");
 }
 
-uint64_t TContainer::GetTotalMemGuarantee(void) const {
+/* Reference implementation for self-check in verbose mode */
+uint64_t TContainer::CountTotalMemGuarantee(void) const {
     uint64_t sum = 0lu;
 
     for (auto &child : Children)
-        sum += child->GetTotalMemGuarantee();
+        sum += child->CountTotalMemGuarantee();
 
     return std::max(NewMemGuarantee, sum);
 }
 
+uint64_t TContainer::GetTotalMemGuarantee(void) const {
+    std::lock_guard<std::mutex> lock(MemGuaranteeMutex);
+
+    if (Verbose) {
+        uint64_t count = CountTotalMemGuarantee();
+        if (count != TotalMemGuarantee)
+            L_ERR() << "Total memory guarantee mismatch for " << Name << ": "
+                    << TotalMemGuarantee << " != " << count << std::endl;
+    }
+
+    return TotalMemGuarantee;
+}
+
+/* Propagate change up to the first unchanged total, under MemGuaranteeMutex */
+void TContainer::PropagateMemGuarantee() {
+    for (auto ct = this; ct; ct = ct->Parent.get()) {
+        uint64_t total = std::max(ct->NewMemGuarantee, ct->ChildrenMemGuarantee);
+        if (total == ct->TotalMemGuarantee)
+            break;
+        uint64_t prev = ct->TotalMemGuarantee;
+        ct->TotalMemGuarantee = total;
+        if (!ct->Linked)
+            break;
+        ct->Parent->ChildrenMemGuarantee += total - prev;
+    }
+}
+
+void TContainer::UpdateTotalMemGuarantee() {
+    std::lock_guard<std::mutex> lock(MemGuaranteeMutex);
+    PropagateMemGuarantee();
+}
+
+/* Add to or remove from parent children list and aggregates */
+void TContainer::LinkParent(bool link) {
+    if (!Parent)
+        return;
+
+    std::lock_guard<std::mutex> lock(MemGuaranteeMutex);
+    if (Linked == link)
+        return;
+    Linked = link;
+
+    if (link) {
+        Parent->Children.emplace_back(shared_from_this());
+        Parent->ChildrenMemGuarantee += TotalMemGuarantee;
+    } else {
+        Parent->Children.remove(shared_from_this());
+        Parent->ChildrenMemGuarantee -= TotalMemGuarantee;
+    }
+
+    Parent->PropagateMemGuarantee();
+}
+
 uint64_t TContainer::GetTotalMemLimit(const TContainer *base) const {
     uint64_t lim = 0;
 
@@ -759,16 +839,23 @@ TError TContainer::PrepareOomMonitor() {
     return error;
 }
 
+bool TContainer::DefaultDevices() const {
+    return Parent && Parent->IsRoot() &&
+        (HasProp(EProperty::DEVICES) || !OwnerCred.IsRootUser());
+}
+
 TError TContainer::ConfigureDevices(std::vector<TDevice> &devices) {
     auto cg = GetCgroup(DevicesSubsystem);
     TDevice device;
     TError error;
 
+    if (!(SupportedControllers & CGROUP_DEVICES) && !Devices.empty())
+        return TError(EError::NotSupported, "Devices cgroup is not supported");
+
     if (IsRoot() || !(Controllers & CGROUP_DEVICES))
         return TError::Success();
 
-    if (Parent->IsRoot() &&
-            (HasProp(EProperty::DEVICES) || !OwnerCred.IsRootUser())) {
+    if (DefaultDevices() && !(PooledControllers & CGROUP_DEVICES)) {
         error = DevicesSubsystem.ApplyDefault(cg);
         if (error)
             return error;
@@ -796,6 +883,8 @@ TError TContainer::ConfigureDevices(std::vector<TDevice> &devices) {
 TError TContainer::PrepareCgroups() {
     TError error;
 
+    PooledControllers = 0;
+
     for (auto hy: Hierarchies) {
         TCgroup cg = GetCgroup(*hy);
 
@@ -805,12 +894,21 @@ TError TContainer::PrepareCgroups() {
         if (cg.Exists()) //FIXME kludge for root and restore
             continue;
 
+        /* Pooled devices cgroups come with default rules */
+        if (!(hy->Controllers & CGROUP_DEVICES) || DefaultDevices()) {
+            error = TakePooledCgroup(cg);
+            if (!error) {
+                PooledControllers |= hy->Controllers;
+                continue;
+            }
+        }
+
         error = cg.Create();
         if (error)
             return error;
     }
 
-    if (Parent && Parent->IsRoot()) {
+    if (Parent && Parent->IsRoot() && !CgroupV2) {
         error = GetCgroup(MemorySubsystem).SetBool(MemorySubsystem.USE_HIERARCHY, true);
         if (error)
             return error;
@@ -942,6 +1040,21 @@ TError TContainer::PrepareTask(struct TTaskEnv *taskEnv,
     taskEnv->CT = shared_from_this();
     taskEnv->Client = CurrentClient;
 
+    taskEnv->Name = Name;
+    taskEnv->Command = Command;
+    taskEnv->IsMeta = IsMeta();
+    taskEnv->Isolate = Isolate;
+    taskEnv->BindDns = BindDns;
+    taskEnv->Hostname = Hostname;
+    taskEnv->ResolvConf = ResolvConf;
+    taskEnv->Rlimit = Rlimit;
+    taskEnv->CapAmbient = CapAmbient;
+    taskEnv->CapLimit = CapLimit;
+    taskEnv->Umask = Umask;
+    taskEnv->Stdin = Stdin;
+    taskEnv->Stdout = Stdout;
+    taskEnv->Stderr = Stderr;
+
     for (auto hy: Hierarchies)
         taskEnv->Cgroups.push_back(GetCgroup(*hy));
 
@@ -998,6 +1111,9 @@ TError TContainer::PrepareTask(struct TTaskEnv *taskEnv,
             taskEnv->TripleFork = true;
     }
 
+    /* Task shares pid namespace and root with portod */
+    taskEnv->Mnt.ProcTemplate = RootTemplateReady && !parent && !Isolate;
+
     if (NetCfg && NetCfg->NetNs.IsOpened())
         taskEnv->ParentNs.Net.EatFd(NetCfg->NetNs);
 
@@ -1061,12 +1177,21 @@ void TContainer::SanitizeCapabilities() {
     }
 }
 
+void TContainer::StartStage(const std::string &stage, uint64_t &mark) {
+    uint64_t now = GetCurrentTimeUs();
+    StartTimings[stage] += now - mark;
+    mark = now;
+}
+
 TError TContainer::Start() {
+    uint64_t startUs = GetCurrentTimeUs(), mark = startUs;
     TError error;
 
     if (State != EContainerState::Stopped)
         return TError(EError::InvalidState, "Cannot start, container is not stopped: " + Name);
 
+    StartTimings.clear();
+
     if (Parent) {
 
         /* Automatically start parent container */
@@ -1074,6 +1199,7 @@ TError TContainer::Start() {
             error = Parent->Start();
             if (error)
                 return error;
+            StartStage("parent", mark);
         }
 
         if (Parent->State == EContainerState::Paused)
@@ -1180,10 +1306,14 @@ TError TContainer::Start() {
     StartTime = GetCurrentTimeMs();
     SetProp(EProperty::START_TIME);
 
+    StartStage("check", mark);
+
     error = PrepareResources();
     if (error)
         return error;
 
+    StartStage("resources", mark);
+
     struct TTaskEnv TaskEnv;
     struct TNetCfg NetCfg;
 
@@ -1195,12 +1325,16 @@ TError TContainer::Start() {
     if (error)
         goto error;
 
+    StartStage("network", mark);
+
     if (!IsRoot()) {
         error = ApplyDynamicProperties();
         if (error)
             return error;
     }
 
+    StartStage("properties", mark);
+
     /* NetNsCapabilities must be isoalted from host net-namespace */
     if (Net == HostNetwork && !CurrentClient->IsSuperUser()) {
         if (CapAmbient.Permitted & NetNsCapabilities.Permitted) {
@@ -1219,6 +1353,8 @@ TError TContainer::Start() {
         if (error)
             goto error;
 
+        StartStage("prepare", mark);
+
         error = TaskEnv.Start();
 
         /* Always report OOM stuation if any */
@@ -1242,6 +1378,23 @@ TError TContainer::Start() {
         SetState(EContainerState::Running);
 
     Statistics->ContainersStarted++;
+
+    StartTimings["total"] = GetCurrentTimeUs() - startUs;
+
+    for (unsigned i = 0; i < StartStages.size(); i++) {
+        auto it = StartTimings.find(StartStages[i]);
+        if (it != StartTimings.end())
+            Statistics->StartStageUs[i] += it->second;
+    }
+
+    for (int i = 0; i < START_LATENCY_BUCKETS; i++) {
+        if (i == START_LATENCY_BUCKETS - 1 ||
+                StartTimings["total"] <= StartLatencyBuckets[i] * 1000) {
+            Statistics->StartLatency[i]++;
+            break;
+        }
+    }
+
     error = UpdateSoftLimit();
     if (error)
         L_ERR() << "Can't update meta soft limit: " << error << std::endl;
@@ -1327,9 +1480,10 @@ void TContainer::FreeResources() {
         for (auto hy: Hierarchies) {
             if (Controllers & hy->Controllers) {
                 auto cg = GetCgroup(*hy);
-                (void)cg.Remove(); //Logged inside
+                (void)ReleaseCgroup(cg); //Logged inside
             }
         }
+        MemSoftLimit = 0;
     }
 
     if (Net) {
@@ -1396,7 +1550,7 @@ void TContainer::FreeResources() {
 
     TPath work_path = WorkPath();
     if (work_path.Exists()) {
-        error = work_path.RemoveAll();
+        error = work_path.RemoveAll(config().volumes().remove_threads());
         if (error)
             L_ERR() << "Cannot remove working dir: " << error << std::endl;
     }
@@ -1443,20 +1597,37 @@ TError TContainer::Terminate(uint64_t deadline) {
         }
     }
 
-    for (int pass = 0; pass < 3; pass++) {
-        if (cg.IsEmpty())
-            return TError::Success();
+    if (cg.IsEmpty())
+        return TError::Success();
+
+    /*
+     * Cgroup.kill atomically kills all and new forks, otherwise freeze
+     * once: nobody could fork or exit and reuse pid while we signal.
+     */
+    if (CgroupV2 && cg.Has("cgroup.kill")) {
         error = cg.KillAll(SIGKILL);
-        if (error)
+    } else {
+        error = FreezerSubsystem.Freeze(cg);
+        if (error) {
+            /* Task stuck in D-state blocks freezer, kill what we can */
+            L_WRN() << "Cannot freeze " << Name << ", kill unfrozen: " << error << std::endl;
+            for (int pass = 0; pass < 3; pass++) {
+                if (cg.IsEmpty())
+                    return TError::Success();
+                (void)cg.KillAll(SIGKILL);
+            }
             return error;
+        }
+        error = cg.KillAll(SIGKILL);
+        TError error2 = FreezerSubsystem.Thaw(cg);
+        if (!error)
+            error = error2;
     }
 
-    error = FreezerSubsystem.Freeze(cg);
-    if (error)
-        return error;
-    error = cg.KillAll(SIGKILL);
-    if (!FreezerSubsystem.Thaw(cg) && !error) {
-        while (!cg.IsEmpty() && !WaitDeadline(deadline));
+    if (!error && deadline) {
+        TError error2 = cg.WaitEmpty(deadline, SIGKILL);
+        if (error2)
+            L_WRN() << "Cannot terminate all tasks in " << Name << " : " << error2 << std::endl;
     }
 
     return error;
@@ -1529,10 +1700,6 @@ TError TContainer::Stop(uint64_t timeout) {
             return error;
     }
 
-    error = UpdateSoftLimit();
-    if (error)
-        L_ERR() << "Can't update meta soft limit: " << error << std::endl;
-
     return TError::Success();
 }
 
@@ -1587,7 +1754,7 @@ void TContainer::Exit(int status, bool oomKilled) {
     if (error)
         L_WRN() << "Can't get container memory.failcnt: " << error << std::endl;
 
-    if (FdHasEvent(OomEvent.Fd) || failcnt)
+    if (CgroupV2 ? HasOomReceived() : (FdHasEvent(OomEvent.Fd) || failcnt))
         oomKilled = true;
 
     /* Detect fatal signals: portoinit cannot kill itself */
@@ -1773,24 +1940,9 @@ TError TContainer::RestoreNetwork() {
     if (error)
         return error;
 
-    Net = TNetwork::GetNetwork(netns.GetInode());
-
-    /* Create a new one */
-    if (!Net) {
-        Net = std::make_shared<TNetwork>();
-        PORTO_ASSERT(Net);
-
-        error = Net->ConnectNetns(netns);
-        if (error)
-            return error;
-
-        TNetwork::AddNetwork(netns.GetInode(), Net);
-
-        error = Net->RefreshDevices();
-        if (error)
-            return error;
-        Net->NewManagedDevices = false;
-    }
+    error = TNetwork::OpenNetwork(netns, Net);
+    if (error)
+        return error;
 
     error = UpdateTrafficClasses();
     if (error)
@@ -1927,24 +2079,40 @@ void TContainer::SyncState() {
         return;
 
     std::vector<pid_t> tasks;
-    error = freezerCg.GetTasks(tasks);
+    error = freezerCg.GetProcesses(tasks);
     if (error)
         L_WRN() << "Cannot dump cgroups " << freezerCg << " " << error << std::endl;
+    std::sort(tasks.begin(), tasks.end());
 
-    for (pid_t pid: tasks) {
-        for (auto hy: Hierarchies) {
-            TCgroup currentCg, correctCg = GetCgroup(*hy);
-            error = hy->TaskCgroup(pid, currentCg);
-            if (error || currentCg == correctCg)
-                continue;
+    /* Compare sets of processes, look into /proc only for strays */
+    for (auto hy: Hierarchies) {
+        if (hy->Controllers & CGROUP_FREEZER)
+            continue;
+
+        TCgroup correctCg = GetCgroup(*hy);
+        std::vector<pid_t> present, missing;
+
+        error = correctCg.GetProcesses(present);
+        if (error) {
+            L_WRN() << "Cannot dump cgroups " << correctCg << " " << error << std::endl;
+            continue;
+        }
+        std::sort(present.begin(), present.end());
+
+        std::set_difference(tasks.begin(), tasks.end(),
+                            present.begin(), present.end(),
+                            std::back_inserter(missing));
+
+        for (pid_t pid: missing) {
+            std::map<const TSubsystem *, TCgroup> current;
 
             /* Recheck freezer cgroup */
-            TCgroup currentFr;
-            error = FreezerSubsystem.TaskCgroup(pid, currentFr);
-            if (error || currentFr != freezerCg)
+            error = TaskCgroups(pid, current);
+            if (error || !current.count(hy) || current[hy] == correctCg ||
+                    current[&FreezerSubsystem].Name != freezerCg.Name)
                 continue;
 
-            L_WRN() << "Task " << pid << " in " << currentCg
+            L_WRN() << "Task " << pid << " in " << current[hy]
                     << " while should be in " << correctCg << std::endl;
             (void)correctCg.Attach(pid);
         }
@@ -2008,6 +2176,15 @@ bool TContainer::MayReceiveOom(int fd) {
 bool TContainer::HasOomReceived() {
     uint64_t val;
 
+    /* Inotify reports any change in memory.events.local, check oom counter */
+    if (CgroupV2) {
+        char buf[sizeof(struct inotify_event) + NAME_MAX + 1];
+        auto cg = GetCgroup(MemorySubsystem);
+
+        while (read(OomEvent.Fd, buf, sizeof(buf)) > 0);
+        return !MemorySubsystem.GetOomEvents(cg, val) && val != 0;
+    }
+
     return read(OomEvent.Fd, &val, sizeof(val)) == sizeof(val) && val != 0;
 }
 
@@ -2056,7 +2233,10 @@ void TContainer::Event(const TEvent &event) {
             error = ct->Lock(lock);
             lock.unlock();
             if (!error) {
-                ct->Exit(SIGKILL, true);
+                if (!CgroupV2 || ct->HasOomReceived())
+                    ct->Exit(SIGKILL, true);
+                else if (ct->MayReceiveOom(event.OOM.Fd))
+                    EpollLoop->StartInput(event.OOM.Fd);
                 ct->Unlock();
             }
         }
@@ -2098,6 +2278,26 @@ void TContainer::Event(const TEvent &event) {
             w->WakeupWaiter(nullptr);
         break;
     }
+    case EEventType::FreezerWait:
+    {
+        lock.unlock();
+        auto cg = FreezerSubsystem.Cgroup(event.FreezerWait.Cgroup);
+        std::string state;
+        error = FreezerSubsystem.GetState(cg, state);
+        /* Container stays locked, if thawed anyway action will handle it */
+        if (!error && state == "FREEZING") {
+            if (GetCurrentTimeMs() < event.FreezerWait.DeadlineMs) {
+                TEvent next = event;
+                next.FreezerWait.BackoffMs = std::min(event.FreezerWait.BackoffMs * 2,
+                                                      (uint64_t)10);
+                FreezerQueue->Add(event.FreezerWait.BackoffMs, next);
+                break;
+            }
+            error = TError(EError::Unknown, "Freezer " + cg.Name + " timeout waiting FROZEN");
+        }
+        event.FreezerWait.Continue(error);
+        break;
+    }
     case EEventType::DestroyWeak:
     {
         if (ct) {
@@ -2174,7 +2374,9 @@ void TContainer::CleanupWaiters() {
     }
 }
 
-TError TContainer::UpdateTrafficClasses() {
+/* Setup classes in host and container networks or only in one of them */
+TError TContainer::UpdateTrafficClasses(TNetwork *only,
+                                        const std::vector<int> *devices) {
     uint32_t handle, parent;
     TError error;
 
@@ -2194,14 +2396,16 @@ TError TContainer::UpdateTrafficClasses() {
             return TError::Success();
     }
 
-    auto net_lock = HostNetwork->ScopedLock();
-    error = HostNetwork->CreateTC(handle, parent, !IsMeta(),
-                                  NetPriority, NetGuarantee, NetLimit);
-    if (error)
-        return error;
-    net_lock.unlock();
+    if (!only || only == HostNetwork.get()) {
+        auto net_lock = HostNetwork->ScopedLock();
+        error = HostNetwork->CreateTC(handle, parent, !IsMeta(),
+                                      NetPriority, NetGuarantee, NetLimit,
+                                      devices);
+        if (error)
+            return error;
+    }
 
-    if (Net && Net != HostNetwork) {
+    if (Net && Net != HostNetwork && (!only || only == Net.get())) {
         if (Controllers & CGROUP_LEGACY)
             parent = TcHandle(ROOT_TC_MAJOR, LEGACY_CONTAINER_ID);
         else
@@ -2214,7 +2418,7 @@ TError TContainer::UpdateTrafficClasses() {
         }
         auto net_lock = Net->ScopedLock();
         error = Net->CreateTC(handle, parent, !IsMeta(),
-                              NetPriority, NetGuarantee, NetLimit);
+                              NetPriority, NetGuarantee, NetLimit, devices);
     }
 
     return error;
@@ -47,11 +47,15 @@ class TContainer : public std::enable_shared_from_this<TContainer>,
 
     TFile OomEvent;
     size_t RunningChildren = 0;
+    uint64_t MemSoftLimit = 0; /* last written into meta cgroup, 0 - unknown */
+    bool Linked = false; /* registered in Parent->Children */
     std::list<std::weak_ptr<TContainerWaiter>> Waiters;
 
     std::shared_ptr<TEpollSource> Source;
 
     // data
+    void LinkParent(bool link);
+    void PropagateMemGuarantee();
     void UpdateRunningChildren(size_t diff);
     TError UpdateSoftLimit();
     void SetState(EContainerState newState);
@@ -62,6 +66,7 @@ class TContainer : public std::enable_shared_from_this<TContainer>,
     TError PrepareOomMonitor();
     void ShutdownOom();
     TError PrepareCgroups();
+    bool DefaultDevices() const;
     TError ConfigureDevices(std::vector<TDevice> &devices);
     TError ParseNetConfig(struct TNetCfg &NetCfg);
     TError PrepareNetwork(struct TNetCfg &NetCfg);
@@ -115,9 +120,11 @@ public:
     std::vector<std::string> DefaultGw;
     std::vector<std::string> ResolvConf;
     std::vector<std::string> Devices;
+    uint64_t PooledControllers = 0; /* cgroups taken from pool at start */
 
     uint64_t StartTime;
     uint64_t DeathTime;
+    TUintMap StartTimings;  /* duration of start stages [us] */
     uint64_t AgingTime;
 
     std::map<int, struct rlimit> Rlimit;
@@ -126,6 +133,9 @@ public:
     uint64_t MemLimit = 0;
     uint64_t MemGuarantee = 0;
     uint64_t NewMemGuarantee = 0;
+    /* max(NewMemGuarantee, ChildrenMemGuarantee), under MemGuaranteeMutex */
+    uint64_t TotalMemGuarantee = 0;
+    uint64_t ChildrenMemGuarantee = 0;
     uint64_t AnonMemLimit = 0;
     uint64_t DirtyMemLimit = 0;
 
@@ -206,6 +216,8 @@ public:
 
     void SanitizeCapabilities();
     uint64_t GetTotalMemGuarantee(void) const;
+    uint64_t CountTotalMemGuarantee(void) const;
+    void UpdateTotalMemGuarantee();
     uint64_t GetTotalMemLimit(const TContainer *base = nullptr) const;
 
     bool IsRoot() const { return Id == ROOT_CONTAINER_ID; }
@@ -223,6 +235,7 @@ public:
     pid_t GetPidFor(pid_t pid) const;
 
     TError Start();
+    void StartStage(const std::string &stage, uint64_t &mark);
     TError StopOne(uint64_t deadline);
     TError Stop(uint64_t timeout);
     TError Pause();
@@ -248,13 +261,14 @@ public:
 
     void AddWaiter(std::shared_ptr<TContainerWaiter> waiter);
 
-    TError UpdateTrafficClasses();
+    TError UpdateTrafficClasses(TNetwork *only = nullptr,
+                                const std::vector<int> *devices = nullptr);
 
     bool MayRespawn();
     bool MayReceiveOom(int fd);
     bool HasOomReceived();
 
-    /* protected with VolumesLock */
+    /* Linked volumes, mirrors TVolume::Containers, protected with VolumesMutex */
     std::list<std::shared_ptr<TVolume>> Volumes;
 
     TError GetEnvironment(TEnv &env);
@@ -296,6 +310,7 @@ extern std::shared_ptr<TContainer> RootContainer;
 extern std::map<std::string, std::shared_ptr<TContainer>> Containers;
 extern TPath ContainersKV;
 extern TIdMap ContainerIdMap;
+extern const std::vector<std::string> StartStages;
 
 static inline std::unique_lock<std::mutex> LockContainers() {
     return std::unique_lock<std::mutex>(ContainersMutex);
@@ -8,7 +8,7 @@
 
 class TEventWorker : public TWorker<TEvent, std::priority_queue<TEvent>> {
 public:
-    TEventWorker(const size_t nr) : TWorker("portod-event", nr) {}
+    TEventWorker(const std::string &name, const size_t nr) : TWorker(name, nr) {}
 
     const TEvent &Top() override {
         return Queue.top();
@@ -58,6 +58,8 @@ std::string TEvent::GetMsg() const {
             return "wait timeout";
         case EEventType::DestroyWeak:
             return "destroy weak";
+        case EEventType::FreezerWait:
+            return "freezer wait " + FreezerWait.Cgroup;
         default:
             return "unknown event";
     }
@@ -77,8 +79,8 @@ void TEventQueue::Add(uint64_t timeoutMs, const TEvent &e) {
     Worker->Push(copy);
 }
 
-TEventQueue::TEventQueue() {
-    Worker = std::make_shared<TEventWorker>(config().daemon().event_workers());
+TEventQueue::TEventQueue(const std::string &name, size_t nr) {
+    Worker = std::make_shared<TEventWorker>(name, nr);
 }
 
 void TEventQueue::Start() {
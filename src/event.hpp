@@ -2,8 +2,10 @@
 
 #include <string>
 #include <memory>
+#include <functional>
 
 #include "util/worker.hpp"
+#include "util/error.hpp"
 
 class TContainer;
 class TContainerWaiter;
@@ -15,6 +17,7 @@ enum class EEventType {
     OOM,
     WaitTimeout,
     DestroyWeak,
+    FreezerWait,
 };
 
 class TEventWorker;
@@ -37,6 +40,13 @@ public:
         std::weak_ptr<TContainerWaiter> Waiter;
     } WaitTimeout;
 
+    struct {
+        std::string Cgroup;
+        uint64_t DeadlineMs;
+        uint64_t BackoffMs;
+        std::function<void(const TError &)> Continue;
+    } FreezerWait;
+
     uint64_t DueMs = 0;
 
     TEvent(EEventType type, std::shared_ptr<TContainer> container = nullptr) :
@@ -51,7 +61,7 @@ class TEventQueue {
     std::shared_ptr<TEventWorker> Worker;
 
 public:
-    TEventQueue();
+    TEventQueue(const std::string &name, size_t nr);
     void Start();
     void Stop();
 
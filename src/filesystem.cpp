@@ -278,12 +278,100 @@ TError TMountNamespace::MountTraceFs() {
     return TError::Success();
 }
 
+static const TPath RootTemplate = "/run/porto/root-template";
+
+bool RootTemplateReady = false;
+
+static const std::vector<std::string> ProcReadOnly = {
+    "/proc/sysrq-trigger",
+    "/proc/irq",
+    "/proc/bus",
+};
+
+/*
+ * /proc with all read-only overlays prepared once in host namespaces.
+ * Container which shares pid namespace with portod gets recursive clone
+ * attached with open_tree() + move_mount() instead of mounting procfs and
+ * remounting each overlay. Template lives in private tmpfs and it's
+ * released at pivot_root() together with the rest of host mounts.
+ */
+TError SetupRootTemplate() {
+    TPath proc = RootTemplate / "proc";
+    TError error;
+
+    RootTemplateReady = false;
+
+    if (!config().container().proc_template())
+        return TError::Success();
+
+    if (RootTemplate.Exists()) {
+        (void)proc.UmountAll();
+        (void)RootTemplate.UmountAll();
+    } else {
+        error = RootTemplate.MkdirAll(0700);
+        if (error)
+            return error;
+    }
+
+    error = RootTemplate.Mount("none", "tmpfs", MS_NOSUID | MS_NODEV | MS_NOEXEC,
+                               { "mode=700", "size=0" });
+    if (!error)
+        error = RootTemplate.Remount(MS_PRIVATE);
+    if (!error)
+        error = proc.Mkdir(0555);
+    if (!error)
+        error = proc.Mount("proc", "proc", MS_NOSUID | MS_NOEXEC | MS_NODEV, {});
+
+    for (auto &p : ProcReadOnly) {
+        TPath path = RootTemplate + p;
+        if (!error)
+            error = path.BindRemount(path, MS_RDONLY);
+    }
+
+    if (!error) {
+        TPath kcore = RootTemplate + "/proc/kcore";
+        error = kcore.BindRemount("/dev/null", MS_RDONLY);
+    }
+
+    /* Probe new mount api */
+    if (!error) {
+        TPath probe = RootTemplate / "probe";
+        error = probe.Mkdir(0700);
+        if (!error)
+            error = probe.AttachClone(proc);
+        if (!error) {
+            (void)probe.UmountAll();
+            (void)probe.Rmdir();
+        }
+    }
+
+    if (error) {
+        (void)proc.UmountAll();
+        (void)RootTemplate.UmountAll();
+        return error;
+    }
+
+    RootTemplateReady = true;
+    return TError::Success();
+}
+
 TError TMountNamespace::MountRootFs() {
     TError error;
 
     if (Root.IsRoot())
         return TError::Success();
 
+    if (ProcTemplate) {
+        TPath proc = Root / "proc";
+        error = proc.MkdirAll(0755);
+        if (!error)
+            error = proc.AttachClone(RootTemplate / "proc");
+        if (error) {
+            L_WRN() << "Cannot attach proc template: " << error << std::endl;
+            ProcTemplate = false;
+        }
+    }
+
     struct {
         std::string target;
         std::string type;
@@ -300,6 +388,8 @@ TError TMountNamespace::MountRootFs() {
     };
 
     for (auto &m : mounts) {
+        if (ProcTemplate && m.type == "proc")
+            continue;
         TPath target = Root + m.target;
         error = target.MkdirAll(0755);
         if (!error)
@@ -380,11 +470,10 @@ TError TMountNamespace::MountRootFs() {
             return error;
     }
 
-    std::vector<std::string> proc_ro = {
-        "/proc/sysrq-trigger",
-        "/proc/irq",
-        "/proc/bus",
-    };
+    std::vector<std::string> proc_ro;
+
+    if (!ProcTemplate)
+        proc_ro = ProcReadOnly;
 
     if (!OwnerCred.IsRootUser())
         proc_ro.push_back("/proc/sys");
@@ -396,10 +485,12 @@ TError TMountNamespace::MountRootFs() {
             return error;
     }
 
-    TPath proc_kcore = Root + "/proc/kcore";
-    error = proc_kcore.BindRemount(Root + "/dev/null", MS_RDONLY);
-    if (error)
-        return error;
+    if (!ProcTemplate) {
+        TPath proc_kcore = Root + "/proc/kcore";
+        error = proc_kcore.BindRemount(Root + "/dev/null", MS_RDONLY);
+        if (error)
+            return error;
+    }
 
     return TError::Success();
 }
@@ -25,6 +25,7 @@ public:
     std::vector<TBindMount> BindMounts;
     bool BindPortoSock;
     uint64_t RunSize;
+    bool ProcTemplate = false; /* clone /proc from RootTemplate */
 
     TError MountBinds();
     TError BindResolvConf();
@@ -36,3 +37,7 @@ public:
 };
 
 bool IsSystemPath(const TPath &path);
+
+/* Prepared /proc for containers in host pid and mount namespaces */
+extern bool RootTemplateReady;
+TError SetupRootTemplate();
@@ -1,31 +1,67 @@
+#include <algorithm>
+
 #include "helpers.hpp"
 #include "common.hpp"
 #include "util/path.hpp"
 #include "util/log.hpp"
 #include "util/unix.hpp"
+#include "util/string.hpp"
 
 extern "C" {
 #include <unistd.h>
+#include <poll.h>
+#include <string.h>
 #include <fcntl.h>
 #include <sys/types.h>
 #include <sys/wait.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/vfs.h>
+#include <sys/syscall.h>
+#include <linux/fs.h>
 #include <linux/loop.h>
 }
 
-TError RunCommand(const std::vector<std::string> &command, const TPath &cwd) {
+/* Progress is called every PROGRESS_PERIOD_MS while command runs */
+#define PROGRESS_PERIOD_MS  5000
+
+/* Without pidfd exit is checked every PROGRESS_POLL_MS */
+#define PROGRESS_POLL_MS    50
+
+TError RunCommand(const std::vector<std::string> &command, const TPath &cwd,
+                  const TFile &output, const TFile &input,
+                  const std::function<void()> &progress) {
     TCgroup memcg = MemorySubsystem.Cgroup(PORTO_HELPERS_CGROUP);
     pid_t pid = fork();
     if (pid < 0)
         return TError(EError::Unknown, errno, "RunCommand: fork");
 
     if (pid > 0) {
-        int ret, status;
-retry:
-        ret = waitpid(pid, &status, 0);
-        if (ret < 0) {
-            if (errno == EINTR)
-                goto retry;
-            return TError(EError::Unknown, errno, "RunCommand: waitpid");
+        int ret = 0, status;
+
+        if (progress) {
+            uint64_t next = GetCurrentTimeMs() + PROGRESS_PERIOD_MS;
+            TFile pidfd;
+
+            pidfd.SetFd = PidfdOpen(pid);
+            while (!(ret = waitpid(pid, &status, WNOHANG))) {
+                uint64_t now = GetCurrentTimeMs();
+                if (now >= next) {
+                    progress();
+                    next = now + PROGRESS_PERIOD_MS;
+                    continue;
+                }
+                if (pidfd.Fd >= 0) {
+                    struct pollfd pfd = { pidfd.Fd, POLLIN, 0 };
+                    (void)poll(&pfd, 1, next - now);
+                } else
+                    usleep(std::min(next - now, (uint64_t)PROGRESS_POLL_MS) * 1000);
+            }
+        }
+        while (ret <= 0) {
+            ret = waitpid(pid, &status, 0);
+            if (ret < 0 && errno != EINTR)
+                return TError(EError::Unknown, errno, "RunCommand: waitpid");
         }
         if (WIFEXITED(status) && !WEXITSTATUS(status))
             return TError::Success();
@@ -39,12 +75,18 @@ retry:
 
     SetDieOnParentExit(SIGKILL);
 
-    TFile::CloseAll({});
+    TFile::CloseAll({output.Fd, input.Fd});
     if (open("/dev/null", O_RDONLY) < 0 ||
             open("/dev/null", O_WRONLY) < 0 ||
             open("/dev/null", O_WRONLY) < 0)
         _exit(EXIT_FAILURE);
 
+    if (output.Fd >= 0 && dup2(output.Fd, STDOUT_FILENO) < 0)
+        _exit(EXIT_FAILURE);
+
+    if (input.Fd >= 0 && dup2(input.Fd, STDIN_FILENO) < 0)
+        _exit(EXIT_FAILURE);
+
     /* Remount everything except CWD Read-Only */
     if (!cwd.IsRoot()) {
         std::list<TMount> mounts;
@@ -68,15 +110,125 @@ retry:
     _exit(2);
 }
 
+static std::string FindProgram(const std::string &name) {
+    for (auto dir: { "/usr/local/bin", "/usr/bin", "/bin" }) {
+        TPath path = TPath(dir) / name;
+        if (path.IsRegularFollow())
+            return path.ToString();
+    }
+    return "";
+}
+
+/*
+ * Multithreaded compressor for format, empty if not installed. Only pixz
+ * also decompresses in parallel, pigz and zstd decompress in one thread.
+ */
+static std::string ParallelCompressor(const std::string &format) {
+    if (format == "gzip")
+        return FindProgram("pigz");
+    if (format == "xz")
+        return FindProgram("pixz");
+    if (format == "zstd")
+        return FindProgram("zstdmt");
+    return "";
+}
+
+static std::string DetectCompression(const TPath &tar) {
+    unsigned char magic[6] = {};
+    TFile file;
+
+    if (file.OpenRead(tar) || read(file.Fd, magic, sizeof(magic)) < 4)
+        return "";
+
+    if (magic[0] == 0x1f && magic[1] == 0x8b)
+        return "gzip";
+    if (!memcmp(magic, "\xfd" "7zXZ\x00", 6))
+        return "xz";
+    if (magic[0] == 0x28 && magic[1] == 0xb5 &&
+            magic[2] == 0x2f && magic[3] == 0xfd)
+        return "zstd";
+    return "";
+}
+
+static void LogProgress(const std::string &action, const TPath &tar,
+                        uint64_t done, uint64_t total, uint64_t start) {
+    uint64_t ms = std::max(GetCurrentTimeMs() - start, (uint64_t)1);
+    L() << action << " " << tar << " " << StringFormatSize(done)
+        << (total ? " of " + StringFormatSize(total) : "") << " "
+        << StringFormatSize(done * 1000 / ms) << "/s" << std::endl;
+}
+
 TError PackTarball(const TPath &tar, const TPath &path) {
-    return RunCommand({ "tar", "--one-file-system", "--numeric-owner",
-                        "--sparse",  "--transform", "s:^./::",
-                        "-cpaf", tar.ToString(),
-                        "-C", path.ToString(), "." }, tar.DirName());
+    std::vector<std::string> command = {
+        "tar", "--one-file-system", "--numeric-owner",
+        "--sparse",  "--transform", "s:^./::" };
+    std::string name = tar.BaseName(), compressor;
+
+    if (StringEndsWith(name, ".tgz") || StringEndsWith(name, ".tar.gz"))
+        compressor = ParallelCompressor("gzip");
+    else if (StringEndsWith(name, ".txz") || StringEndsWith(name, ".tar.xz"))
+        compressor = ParallelCompressor("xz");
+
+    if (compressor != "") {
+        command.push_back("--use-compress-program=" + compressor);
+        command.push_back("-cpf");
+    } else
+        command.push_back("-cpaf");
+
+    command.insert(command.end(), { tar.ToString(), "-C", path.ToString(), "." });
+
+    uint64_t start = GetCurrentTimeMs();
+    TError error = RunCommand(command, tar.DirName(), TFile(), TFile(), [&] () {
+        struct stat st;
+        if (!tar.StatStrict(st))
+            LogProgress("Pack", tar, st.st_size, 0, start);
+    });
+
+    struct stat st;
+    if (!error && !tar.StatStrict(st))
+        LogProgress("Packed", tar, st.st_size, 0, start);
+
+    return error;
 }
 
-TError UnpackTarball(const TPath &tar, const TPath &path) {
-    return RunCommand({ "tar", "--numeric-owner", "-pxf", tar.ToString()}, path);
+/*
+ * If list is set, tar prints names of extracted entries into it.
+ * Tarball is fed as stdin: its offset in shared file shows progress,
+ * which is reported only into portod log.
+ */
+TError UnpackTarball(const TPath &tar, const TPath &path, const TFile &list) {
+    std::vector<std::string> command = { "tar", "--numeric-owner" };
+    std::string format = DetectCompression(tar);
+    std::string compressor = ParallelCompressor(format);
+    uint64_t start = GetCurrentTimeMs();
+    struct stat st;
+    TFile input;
+
+    TError error = input.OpenRead(tar);
+    if (error)
+        return error;
+
+    if (fstat(input.Fd, &st))
+        return TError(EError::Unknown, errno, "fstat(" + tar.ToString() + ")");
+
+    if (compressor == "" && format != "")
+        compressor = format;
+    if (compressor != "")
+        command.push_back("--use-compress-program=" + compressor);
+
+    command.push_back(list.Fd >= 0 ? "-pxvf" : "-pxf");
+    command.push_back("-");
+
+    error = RunCommand(command, path, list, input, [&] () {
+        off_t done = lseek(input.Fd, 0, SEEK_CUR);
+        if (done >= 0)
+            LogProgress("Unpack", tar, done, st.st_size, start);
+    });
+
+    if (!error)
+        LogProgress("Unpacked", tar, st.st_size, st.st_size, start);
+
+    return error;
 }
 
 TError CopyRecursive(const TPath &src, const TPath &dst) {
@@ -85,9 +237,76 @@ TError CopyRecursive(const TPath &src, const TPath &dst) {
                         src.ToString(), "." }, dst);
 }
 
-TError ResizeLoopDev(int loopNr, const TPath &image, off_t current, off_t target) {
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+
+#ifndef EXT4_IOC_RESIZE_FS
+#define EXT4_IOC_RESIZE_FS _IOW('f', 16, uint64_t)
+#endif
+
+/* Reflink whole file or copy only data extents if not supported */
+TError CloneFile(const TFile &src, const TFile &dst) {
+    struct stat st;
+
+    if (!ioctl(dst.Fd, FICLONE, src.Fd))
+        return TError::Success();
+
+    if (errno != EOPNOTSUPP && errno != ENOTTY &&
+            errno != EXDEV && errno != EINVAL)
+        return TError(EError::Unknown, errno, "ioctl(FICLONE)");
+
+    if (fstat(src.Fd, &st))
+        return TError(EError::Unknown, errno, "fstat");
+
+    if (ftruncate(dst.Fd, st.st_size))
+        return TError(EError::Unknown, errno, "ftruncate");
+
+    off_t data = 0, hole;
+    while ((data = lseek(src.Fd, data, SEEK_DATA)) >= 0) {
+        hole = lseek(src.Fd, data, SEEK_HOLE);
+        if (hole < 0)
+            return TError(EError::Unknown, errno, "lseek(SEEK_HOLE)");
+
+        while (data < hole) {
+            loff_t in = data, out = data;
+            ssize_t ret = syscall(SYS_copy_file_range, src.Fd, &in,
+                                  dst.Fd, &out, hole - data, 0);
+            if (ret <= 0)
+                return TError(EError::Unknown, ret ? errno : EIO, "copy_file_range");
+            data += ret;
+        }
+    }
+
+    if (errno != ENXIO)
+        return TError(EError::Unknown, errno, "lseek(SEEK_DATA)");
+
+    return TError::Success();
+}
+
+/* Online grow of mounted ext4 */
+TError GrowExt4(const TPath &mount, off_t size) {
+    struct statfs st;
+    uint64_t blocks;
+    TFile dir;
+
+    TError error = dir.OpenDir(mount);
+    if (error)
+        return error;
+
+    if (fstatfs(dir.Fd, &st))
+        return TError(EError::Unknown, errno, "fstatfs(" + mount.ToString() + ")");
+
+    blocks = size / st.f_bsize;
+    if (ioctl(dir.Fd, EXT4_IOC_RESIZE_FS, &blocks))
+        return TError(EError::Unknown, errno, "ioctl(EXT4_IOC_RESIZE_FS)");
+
+    return TError::Success();
+}
+
+TError ResizeLoopDev(int loopNr, const TPath &image, const TPath &mount,
+                     off_t current, off_t target) {
     auto path = "/dev/loop" + std::to_string(loopNr);
-    auto size = std::to_string(target >> 10) + "K";
     TError error;
     TFile dev;
 
@@ -105,5 +324,5 @@ TError ResizeLoopDev(int loopNr, const TPath &image, off_t current, off_t target
     if (ioctl(dev.Fd, LOOP_SET_CAPACITY, 0) < 0)
         return TError(EError::Unknown, errno, "ioctl(LOOP_SET_CAPACITY)");
 
-    return RunCommand({"resize2fs", path, size}, "/");
+    return GrowExt4(mount, target);
 }
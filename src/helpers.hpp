@@ -1,10 +1,17 @@
 #include <cgroup.hpp>
 #include <string>
 #include <vector>
+#include <functional>
 #include "util/path.hpp"
 
-TError RunCommand(const std::vector<std::string> &command, const TPath &cwd);
+TError RunCommand(const std::vector<std::string> &command, const TPath &cwd,
+                  const TFile &output = TFile(), const TFile &input = TFile(),
+                  const std::function<void()> &progress = nullptr);
 TError PackTarball(const TPath &tar, const TPath &path);
-TError UnpackTarball(const TPath &tar, const TPath &path);
+TError UnpackTarball(const TPath &tar, const TPath &path,
+                     const TFile &list = TFile());
 TError CopyRecursive(const TPath &src, const TPath &dst);
-TError ResizeLoopDev(int loopNr, const TPath &image, off_t current, off_t target);
+TError CloneFile(const TFile &src, const TFile &dst);
+TError GrowExt4(const TPath &mount, off_t size);
+TError ResizeLoopDev(int loopNr, const TPath &image, const TPath &mount,
+                     off_t current, off_t target);
@@ -7,9 +7,21 @@
 #include <util/unix.hpp>
 #include <util/log.hpp>
 #include <util/string.hpp>
+#include <util/worker.hpp>
+#include <statistics.hpp>
+#include <fstream>
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <map>
+#include <unordered_map>
 
 extern "C" {
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
 #include <sys/stat.h>
+#include <sys/xattr.h>
 }
 
 static unsigned LayerRemoveCounter = 0;
@@ -27,6 +39,200 @@ static bool PathIsActive(const TPath &path) {
 
 static std::condition_variable LayersCv;
 
+class TLayerWorker : public TWorker<std::function<void()>> {
+public:
+    TLayerWorker(size_t nr) : TWorker("portod-layer", nr) {}
+
+    const std::function<void()> &Top() override {
+        return Queue.front();
+    }
+
+    bool Handle(const std::function<void()> &task) override {
+        Statistics->LayerTasksQueued--;
+        task();
+        return true;
+    }
+};
+
+static std::unique_ptr<TLayerWorker> LayerWorker;
+
+static void CollectObjectRefs(const TPath &objects, const TPath &tree,
+                              std::map<ino_t, struct stat> &refs);
+static void ReclaimObjects(const TPath &objects,
+                           const std::map<ino_t, struct stat> &refs);
+static void AddCollectorPlace(const TPath &place);
+
+/*
+ * Junk: trees renamed into per-place junk directory and removed in
+ * background by single low io priority thread with optional rate limit.
+ */
+class TReclaimer : public TWorker<TPath> {
+    uint64_t Second = 0;
+    uint64_t Budget = 0;
+
+    std::mutex ThrottleMutex;
+
+    /* Called by remover threads after each removed entry */
+    bool Throttle() {
+        uint64_t rate = config().volumes().reclaim_rate();
+
+        Statistics->JunkFilesRemoved++;
+
+        if (rate) {
+            std::unique_lock<std::mutex> lock(ThrottleMutex);
+            uint64_t now = GetCurrentTimeMs();
+            if (now / 1000 != Second) {
+                Second = now / 1000;
+                Budget = 0;
+            }
+            if (++Budget > rate) {
+                usleep((1000 - now % 1000) * 1000);
+                Second = GetCurrentTimeMs() / 1000;
+                Budget = 1;
+            }
+        }
+
+        return Valid;
+    }
+
+public:
+    TReclaimer() : TWorker("portod-reclaim", 1) {}
+
+    const TPath &Top() override {
+        return Queue.front();
+    }
+
+    bool Handle(const TPath &place) override {
+        TPath junk = place / config().volumes().junk_dir();
+        TPath objects = place / config().volumes().objects_dir();
+        bool dedup = config().volumes().layer_dedup();
+        std::map<ino_t, struct stat> refs;
+        std::vector<std::string> content;
+        TError error;
+
+        error = SetIoPrio(GetTid(), config().volumes().reclaim_io_class(), 7);
+        if (error)
+            L_WRN() << "Cannot set reclaimer io priority: " << error << std::endl;
+
+        if (junk.ReadDirectory(content))
+            return true;
+
+        for (auto &entry: content) {
+            TPath path = junk / entry;
+
+            if (path.IsDirectoryStrict()) {
+                if (dedup)
+                    CollectObjectRefs(objects, path, refs);
+                error = path.ClearDirectory(config().volumes().remove_threads(),
+                                            [this] { return Throttle(); });
+                if (!error)
+                    error = path.Rmdir();
+            } else
+                error = path.Unlink();
+
+            if (error) {
+                if (Valid)
+                    L_WRN() << "Cannot reclaim junk: " << error << std::endl;
+                continue;
+            }
+            Statistics->JunkReclaimed++;
+        }
+
+        if (Valid && dedup)
+            ReclaimObjects(objects, refs);
+
+        return true;
+    }
+};
+
+static TReclaimer Reclaimer;
+static std::mutex ReclaimMutex;
+static std::set<TPath> ReclaimPlaces;
+static uint64_t JunkCounter = 0;
+
+/* Pick up junk left in place by previous daemon instances */
+static void ScheduleReclaim(const TPath &place) {
+    std::unique_lock<std::mutex> lock(ReclaimMutex);
+    if (ReclaimPlaces.insert(place).second)
+        Reclaimer.Push(place);
+}
+
+void StartReclaimer() {
+    Reclaimer.Start();
+}
+
+void StopReclaimer() {
+    Reclaimer.Stop();
+}
+
+TError MoveToJunk(const TPath &place, const TPath &path) {
+    TPath junk = place / config().volumes().junk_dir();
+    TError error;
+
+    if (!junk.IsDirectoryStrict())
+        error = junk.MkdirAll(0700);
+
+    if (!error) {
+        std::unique_lock<std::mutex> lock(ReclaimMutex);
+        std::string name = std::to_string(GetCurrentTimeMs()) + "-" +
+                           std::to_string(JunkCounter++);
+        lock.unlock();
+        error = path.Rename(junk / name);
+    }
+
+    if (error) {
+        L_WRN() << "Cannot move " << path << " into junk: " << error << std::endl;
+        return path.RemoveAll(config().volumes().remove_threads());
+    }
+
+    Statistics->JunkQueued++;
+    Reclaimer.Push(place);
+
+    return TError::Success();
+}
+
+TError ClearToJunk(const TPath &place, const TPath &dir) {
+    std::vector<std::string> content;
+    TError error, ret;
+
+    error = dir.ReadDirectory(content);
+    if (error)
+        return error;
+
+    for (auto &entry: content) {
+        error = MoveToJunk(place, dir / entry);
+        if (error && !ret)
+            ret = error;
+    }
+
+    return ret;
+}
+
+/* Tasks queued during restore are started together with workers */
+static void InitLayerWorkers() {
+    if (!LayerWorker)
+        LayerWorker = std::unique_ptr<TLayerWorker>(
+                new TLayerWorker(std::max(1, config().volumes().layer_workers())));
+}
+
+void StartLayerWorkers() {
+    InitLayerWorkers();
+    LayerWorker->Start();
+}
+
+void StopLayerWorkers() {
+    if (LayerWorker) {
+        LayerWorker->Stop();
+        LayerWorker = nullptr;
+    }
+}
+
+void QueueLayerTask(const std::function<void()> &task) {
+    InitLayerWorkers();
+    Statistics->LayerTasksQueued++;
+    LayerWorker->Push(task);
+}
+
 TError CheckPlace(const TPath &place, bool init) {
     struct stat st;
     TError error;
@@ -64,6 +270,21 @@ TError CheckPlace(const TPath &place, bool init) {
     if ((st.st_mode & 0777) != 0700)
         layers.Chmod(0700);
 
+    if (config().volumes().layer_dedup()) {
+        TPath objects = place / config().volumes().objects_dir();
+        if (init && !objects.IsDirectoryStrict()) {
+            (void)objects.Unlink();
+            error = objects.MkdirAll(0700);
+            if (error)
+                return error;
+        }
+    }
+
+    if ((place / config().volumes().junk_dir()).IsDirectoryStrict())
+        ScheduleReclaim(place);
+
+    AddCollectorPlace(place);
+
     std::vector<std::string> list;
     error = layers.ListSubdirs(list);
     if (error)
@@ -80,7 +301,7 @@ TError CheckPlace(const TPath &place, bool init) {
             continue;
         lock.unlock();
 
-        error = path.RemoveAll();
+        error = MoveToJunk(place, path);
         if (error)
             L_WRN() << "cannot delete junk layer: " << path << " : " << error << std::endl;
     }
@@ -109,11 +330,280 @@ bool LayerInUse(const std::string &name, const TPath &place) {
     return false;
 }
 
+/*
+ * Content-addressed object store: identical regular files from all layers
+ * in place are hardlinked to one object named after content hash and inode
+ * attributes. Link count is the reference count, objects with single link
+ * are not used by any layer and reclaimed after layer removal.
+ *
+ * Inode to hash index lets reclaimer find objects of removed files without
+ * scanning the store. It is loaded by one full scan and reloaded after
+ * operations which drop links without reclaimer: merge and failed import.
+ */
+
+struct TObjectIndex {
+    bool Loaded = false;
+    std::unordered_map<ino_t, uint64_t> Hashes;
+};
+
+static std::mutex ObjectsMutex;
+static std::map<TPath, TObjectIndex> ObjectIndex;
+
+static std::string ObjectName(uint64_t hash, const struct stat &st) {
+    /* Mtime is keyed too: caches like .pyc and make depend on it */
+    return StringFormat("%016lx-%lu-%o-%u-%u-%lx.%09lu", (unsigned long)hash,
+            (unsigned long)st.st_size, st.st_mode & 07777, st.st_uid, st.st_gid,
+            (unsigned long)st.st_mtim.tv_sec, (unsigned long)st.st_mtim.tv_nsec);
+}
+
+static void IndexObject(const TPath &objects, ino_t ino, uint64_t hash) {
+    std::unique_lock<std::mutex> lock(ObjectsMutex);
+    ObjectIndex[objects].Hashes[ino] = hash;
+}
+
+static void InvalidateObjects(const TPath &objects) {
+    std::unique_lock<std::mutex> lock(ObjectsMutex);
+    ObjectIndex[objects].Loaded = false;
+}
+
+static TError HashFile(const TFile &file, uint64_t &hash) {
+    char buf[65536];
+    ssize_t len;
+
+    /* FNV-1a, collisions are resolved by comparing content */
+    hash = 14695981039346656037ull;
+
+    off_t off = 0;
+    while ((len = pread(file.Fd, buf, sizeof(buf), off)) > 0) {
+        for (ssize_t i = 0; i < len; i++)
+            hash = (hash ^ (unsigned char)buf[i]) * 1099511628211ull;
+        off += len;
+    }
+    if (len < 0)
+        return TError(EError::Unknown, errno, "read");
+    return TError::Success();
+}
+
+static bool SameContent(const TFile &a, const TFile &b) {
+    char bufa[65536], bufb[65536];
+    off_t off = 0;
+    ssize_t lena, lenb;
+
+    do {
+        lena = pread(a.Fd, bufa, sizeof(bufa), off);
+        lenb = pread(b.Fd, bufb, sizeof(bufb), off);
+        if (lena != lenb || lena < 0 || memcmp(bufa, bufb, lena))
+            return false;
+        off += lena;
+    } while (lena > 0);
+
+    return true;
+}
+
+static TError DedupFile(const TPath &objects, const TPath &path,
+                        const struct stat &st) {
+    TFile file, object_file;
+    uint64_t hash;
+    TError error;
+
+    /* Inode attributes are shared between hardlinks, xattrs are not keyed */
+    if (llistxattr(path.c_str(), nullptr, 0) != 0)
+        return TError::Success();
+
+    error = file.Open(path, O_RDONLY | O_NOFOLLOW | O_NOCTTY | O_CLOEXEC);
+    if (error)
+        return error;
+
+    error = HashFile(file, hash);
+    if (error)
+        return error;
+
+    std::string name = ObjectName(hash, st);
+    TPath shard = objects / name.substr(0, 2);
+    TPath object = shard / name;
+
+    for (int retry = 0; retry < 2; retry++) {
+        if (object_file.Open(object, O_RDONLY | O_NOFOLLOW | O_CLOEXEC)) {
+            /* New object */
+            if (!shard.IsDirectoryStrict()) {
+                error = shard.Mkdir(0700);
+                if (error && error.GetErrno() != EEXIST)
+                    return error;
+            }
+            error = object.Hardlink(path);
+            if (error && error.GetErrno() == EEXIST)
+                continue;
+            if (!error)
+                IndexObject(objects, st.st_ino, hash);
+            return error;
+        }
+
+        if (!SameContent(file, object_file))
+            return TError::Success();
+
+        TPath temp = path.DirName() / (LAYER_TMP_PREFIX + path.BaseName());
+        error = temp.Hardlink(object);
+        if (error && error.GetErrno() == ENOENT) {
+            /* Object reclaimed meanwhile */
+            object_file.Close();
+            continue;
+        }
+        if (error && error.GetErrno() == EEXIST)
+            return TError::Success();
+        if (!error)
+            error = temp.Rename(path);
+        if (error) {
+            (void)temp.Unlink();
+            return error;
+        }
+
+        Statistics->LayerDedupFiles++;
+        Statistics->LayerDedupBytes += st.st_size;
+        return TError::Success();
+    }
+
+    return TError::Success();
+}
+
+static TError DedupLayer(const TPath &objects, const TPath &dir) {
+    std::vector<std::string> content;
+    struct stat st;
+
+    TError error = dir.ReadDirectory(content);
+    if (error)
+        return error;
+
+    for (auto &entry: content) {
+        TPath path = dir / entry;
+
+        error = path.StatStrict(st);
+        if (error)
+            return error;
+
+        if (S_ISDIR(st.st_mode))
+            error = DedupLayer(objects, path);
+        else if (S_ISREG(st.st_mode) && st.st_nlink == 1 && st.st_size)
+            error = DedupFile(objects, path, st);
+        if (error)
+            return error;
+    }
+
+    return TError::Success();
+}
+
+/* Full scan: removes objects not linked into any layer, indexes others */
+static void LoadObjects(const TPath &objects) {
+    std::vector<std::string> shards, names;
+    std::vector<std::pair<ino_t, uint64_t>> found;
+    struct stat st;
+    TError error;
+
+    if (objects.ReadDirectory(shards))
+        return;
+
+    for (auto &shard: shards) {
+        if ((objects / shard).ReadDirectory(names))
+            continue;
+
+        for (auto &name: names) {
+            TPath object = objects / shard / name;
+            if (object.StatStrict(st))
+                continue;
+            if (st.st_nlink == 1) {
+                error = object.Unlink();
+                if (error)
+                    L_WRN() << "Cannot remove layer object: " << error << std::endl;
+            } else
+                found.emplace_back(st.st_ino, strtoull(name.substr(0, 16).c_str(), nullptr, 16));
+        }
+    }
+
+    std::unique_lock<std::mutex> lock(ObjectsMutex);
+    auto &index = ObjectIndex[objects];
+    for (auto &it: found)
+        index.Hashes[it.first] = it.second;
+    index.Loaded = true;
+}
+
+/* Remember shared files in tree before removal, they might be last links */
+static void CollectObjectRefs(const TPath &objects, const TPath &tree,
+                              std::map<ino_t, struct stat> &refs) {
+    std::mutex mutex;
+
+    std::unique_lock<std::mutex> lock(ObjectsMutex);
+    auto &index = ObjectIndex[objects];
+    if (!index.Loaded || index.Hashes.empty())
+        return;
+    lock.unlock();
+
+    (void)tree.WalkParallel(config().volumes().remove_threads(),
+            [&] (const TFile &dir, const std::string &name) {
+        struct stat st;
+        if (!fstatat(dir.Fd, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) &&
+                S_ISREG(st.st_mode) && st.st_nlink > 1) {
+            std::unique_lock<std::mutex> lock(mutex);
+            refs[st.st_ino] = st;
+        }
+        return TError::Success();
+    });
+}
+
+/* Remove objects of removed files which are not linked into any layer */
+static void ReclaimObjects(const TPath &objects,
+                           const std::map<ino_t, struct stat> &refs) {
+    std::vector<std::pair<const struct stat *, uint64_t>> candidates;
+    struct stat st;
+    TError error;
+
+    std::unique_lock<std::mutex> lock(ObjectsMutex);
+    auto &index = ObjectIndex[objects];
+    if (!index.Loaded) {
+        lock.unlock();
+        LoadObjects(objects);
+        return;
+    }
+    for (auto &ref: refs) {
+        auto it = index.Hashes.find(ref.first);
+        if (it != index.Hashes.end())
+            candidates.emplace_back(&ref.second, it->second);
+    }
+    lock.unlock();
+
+    for (auto &it: candidates) {
+        std::string name = ObjectName(it.second, *it.first);
+        TPath object = objects / name.substr(0, 2) / name;
+
+        if (object.StatStrict(st) || st.st_ino != it.first->st_ino)
+            continue;
+
+        if (st.st_nlink == 1) {
+            error = object.Unlink();
+            if (error) {
+                L_WRN() << "Cannot remove layer object: " << error << std::endl;
+                continue;
+            }
+            lock.lock();
+            index.Hashes.erase(st.st_ino);
+            lock.unlock();
+        }
+    }
+}
+
+static std::mutex LayerSizesMutex;
+static std::map<TPath, std::pair<ino_t, uint64_t>> LayerSizes;
+
+static void ForgetLayerSize(const TPath &layer) {
+    std::unique_lock<std::mutex> lock(LayerSizesMutex);
+    LayerSizes.erase(layer);
+}
+
 TError ImportLayer(const std::string &name, const TPath &place,
                    const TPath &tarball, bool merge) {
     TPath layers = place / config().volumes().layers_dir();
     TPath layer = layers / name;
     TPath layer_tmp = layers / LAYER_IMPORT_PREFIX + name;
+    uint64_t start = GetCurrentTimeMs();
+    TFile list;
     TError error;
 
     error = ValidateLayerName(name);
@@ -136,6 +626,7 @@ TError ImportLayer(const std::string &name, const TPath &place,
         error = layer.Rename(layer_tmp);
         if (error)
             return error;
+        ForgetLayerSize(layer);
     } else {
         if (merge)
             return TError(EError::LayerNotFound, "Layer for merge not found");
@@ -147,31 +638,59 @@ TError ImportLayer(const std::string &name, const TPath &place,
     ActivePaths.push_back(layer_tmp);
     volumes_lock.unlock();
 
-    error = UnpackTarball(tarball, layer_tmp);
+    /* Collect entry names during extraction to avoid walking layer later */
+    if (list.CreateTemp(layers))
+        L_WRN() << "Cannot create layer listing, fallback to full scan" << std::endl;
+
+    error = UnpackTarball(tarball, layer_tmp, list);
     if (error)
         goto err;
 
-    error = SanitizeLayer(layer_tmp, merge);
+    if (list.Fd >= 0)
+        error = SanitizeListedLayer(layer_tmp, list, merge);
+    else
+        error = SanitizeLayer(layer_tmp, merge);
     if (error)
         goto err;
 
+    if (config().volumes().layer_dedup()) {
+        TPath objects = place / config().volumes().objects_dir();
+        /* Merge replaces files, old links are dropped past reclaimer */
+        if (merge)
+            InvalidateObjects(objects);
+        if (!objects.IsDirectoryStrict())
+            error = objects.MkdirAll(0700);
+        if (!error)
+            error = DedupLayer(objects, layer_tmp);
+        if (error)
+            L_WRN() << "Cannot deduplicate layer " << name << " : " << error << std::endl;
+    }
+
     volumes_lock.lock();
     error = layer_tmp.Rename(layer);
-    if (!error)
+    if (!error) {
         ActivePaths.remove(layer_tmp);
+        TouchLayer(name, place);
+    }
     volumes_lock.unlock();
     if (error)
         goto err;
 
     LayersCv.notify_all();
 
+    L_ACT() << "Layer " << name << " imported in "
+            << GetCurrentTimeMs() - start << "ms" << std::endl;
+
     return TError::Success();
 
 err:
-    TError error2 = layer_tmp.RemoveAll();
+    TError error2 = layer_tmp.RemoveAll(config().volumes().remove_threads());
     if (error2)
         L_WRN() << "Cannot cleanup layer: " << error2 << std::endl;
 
+    if (config().volumes().layer_dedup())
+        InvalidateObjects(place / config().volumes().objects_dir());
+
     volumes_lock.lock();
     ActivePaths.remove(layer_tmp);
     volumes_lock.unlock();
@@ -209,7 +728,9 @@ TError RemoveLayer(const std::string &name, const TPath &place) {
     if (error)
         return error;
 
-    error = layer_tmp.RemoveAll();
+    ForgetLayerSize(layer);
+
+    error = MoveToJunk(place, layer_tmp);
     if (error)
         L_WRN() << "Cannot remove layer: " << error << std::endl;
 
@@ -220,6 +741,228 @@ TError RemoveLayer(const std::string &name, const TPath &place) {
     return error;
 }
 
+/*
+ * Layer GC: last usage is kept in atime of layer directory, it is set at
+ * import and volume build. When usage of place is above high watermark
+ * unused layers are removed in LRU order until it drops below low one.
+ */
+void TouchLayer(const std::string &name, const TPath &place) {
+    TError error = (place / config().volumes().layers_dir() / name).TouchAccess();
+    if (error)
+        L_WRN() << "Cannot update layer " << name << " usage: " << error << std::endl;
+}
+
+/*
+ * Estimated space released by removal, shared objects are not counted.
+ * Layers are immutable except merge, so walk is cached by directory inode.
+ */
+static uint64_t LayerSize(const TPath &layer) {
+    std::atomic<uint64_t> size(0);
+    struct stat st;
+
+    if (layer.StatStrict(st))
+        return 0;
+
+    std::unique_lock<std::mutex> lock(LayerSizesMutex);
+    auto it = LayerSizes.find(layer);
+    if (it != LayerSizes.end() && it->second.first == st.st_ino)
+        return it->second.second;
+    lock.unlock();
+
+    (void)layer.WalkParallel(config().volumes().remove_threads(),
+            [&] (const TFile &dir, const std::string &name) {
+        struct stat st;
+        if (!fstatat(dir.Fd, name.c_str(), &st, AT_SYMLINK_NOFOLLOW) &&
+                S_ISREG(st.st_mode) && st.st_nlink == 1)
+            size += st.st_blocks * 512;
+        return TError::Success();
+    });
+
+    lock.lock();
+    LayerSizes[layer] = { st.st_ino, size };
+
+    return size;
+}
+
+/* Watermarks are percents of place size, zero high collects all unused */
+TError CollectLayers(const TPath &place, bool dry_run,
+                     std::vector<std::string> &collected,
+                     uint64_t high, uint64_t low, uint64_t min_age) {
+    TPath layers = place / config().volumes().layers_dir();
+    std::vector<std::pair<time_t, std::string>> lru;
+    std::vector<std::string> list;
+    uint64_t total, target, freed = 0;
+    time_t now = time(nullptr);
+    TStatFS stat;
+    TError error;
+
+    low = std::min(high, low);
+
+    error = place.StatFS(stat);
+    if (error)
+        return error;
+
+    total = stat.SpaceUsage + stat.SpaceAvail;
+    if (stat.SpaceUsage * 100 < total * high)
+        return TError::Success();
+
+    target = stat.SpaceUsage - total * low / 100;
+
+    error = layers.ListSubdirs(list);
+    if (error)
+        return error;
+
+    for (auto &name: list) {
+        struct stat st;
+
+        if (LayerIsJunk(name) || (layers / name).StatStrict(st))
+            continue;
+
+        time_t used = std::max(st.st_atime, st.st_ctime);
+        if (used + (time_t)min_age > now)
+            continue;
+
+        lru.emplace_back(used, name);
+    }
+
+    std::sort(lru.begin(), lru.end());
+
+    for (auto &it: lru) {
+        auto &name = it.second;
+        TPath layer = layers / name;
+
+        if (freed >= target)
+            break;
+
+        auto volumes_lock = LockVolumes();
+        if (LayerInUse(name, place))
+            continue;
+        volumes_lock.unlock();
+
+        uint64_t size = LayerSize(layer);
+
+        if (!dry_run) {
+            /* Rechecks usage under lock, races with volumes and imports */
+            error = RemoveLayer(name, place);
+            if (error) {
+                if (error.GetError() != EError::Busy &&
+                        error.GetError() != EError::LayerNotFound)
+                    L_WRN() << "Cannot collect layer " << name << " : " << error << std::endl;
+                continue;
+            }
+
+            L_ACT() << "Collected layer " << name << " unused for "
+                    << now - it.first << "s" << std::endl;
+
+            Statistics->LayersCollected++;
+            Statistics->LayersCollectedBytes += size;
+        }
+
+        collected.push_back(name);
+        freed += size;
+    }
+
+    if (!dry_run)
+        Statistics->LayerGcRuns++;
+
+    return TError::Success();
+}
+
+static std::mutex CollectorMutex;
+static std::set<TPath> CollectorPlaces;
+
+static void AddCollectorPlace(const TPath &place) {
+    std::unique_lock<std::mutex> lock(CollectorMutex);
+    CollectorPlaces.insert(place);
+}
+
+class TLayerCollector : public TWorker<int> {
+public:
+    TLayerCollector() : TWorker("portod-layer-gc", 1) {}
+
+    void Wait(TScopedLock &lock) override {
+        if (Valid)
+            Cv.wait_for(lock, std::chrono::milliseconds(
+                        config().volumes().layer_gc_interval_ms()));
+    }
+
+    const int &Top() override {
+        return Queue.front();
+    }
+
+    /* Never completes: requeued and handled again after timeout */
+    bool Handle(const int &) override {
+        std::unique_lock<std::mutex> lock(CollectorMutex);
+        auto places = CollectorPlaces;
+        lock.unlock();
+
+        uint64_t high = config().volumes().layer_gc_high_watermark();
+        if (!high)
+            return false;
+
+        for (auto &place: places) {
+            std::vector<std::string> collected;
+            TError error = CollectLayers(place, false, collected, high,
+                                         config().volumes().layer_gc_low_watermark(),
+                                         config().volumes().layer_gc_min_age());
+            if (error)
+                L_WRN() << "Cannot collect layers in " << place << " : " << error << std::endl;
+        }
+
+        return false;
+    }
+};
+
+static TLayerCollector LayerCollector;
+
+void StartLayerCollector() {
+    LayerCollector.Push(0);
+    LayerCollector.Start();
+}
+
+void StopLayerCollector() {
+    LayerCollector.Stop();
+}
+
+/* Handle aufs whiteouts and metadata */
+static TError SanitizeWhiteout(const TPath &layer, const std::string &entry, bool merge) {
+    TPath path = layer / entry;
+    TError error;
+
+    /* Remove it completely */
+    error = path.RemoveAll();
+    if (error)
+        return error;
+
+    /* Opaque directory - hide entries in lower layers */
+    if (entry == ".wh..wh..opq") {
+        error = layer.SetXAttr("trusted.overlay.opaque", "y");
+        if (error)
+            return error;
+    }
+
+    /* Metadata is done */
+    if (entry.compare(0, 8, ".wh..wh.") == 0)
+        return TError::Success();
+
+    /* Remove whiteouted entry */
+    path = layer / entry.substr(4);
+    if (path.Exists()) {
+        error = path.RemoveAll();
+        if (error)
+            return error;
+    }
+
+    if (!merge) {
+        /* Convert into overlayfs whiteout */
+        error = path.Mknod(S_IFCHR, 0);
+        if (error)
+            return error;
+    }
+
+    return TError::Success();
+}
+
 TError SanitizeLayer(TPath layer, bool merge) {
     std::vector<std::string> content;
 
@@ -230,40 +973,10 @@ TError SanitizeLayer(TPath layer, bool merge) {
     for (auto entry: content) {
         TPath path = layer / entry;
 
-        /* Handle aufs whiteouts and metadata */
         if (entry.compare(0, 4, ".wh.") == 0) {
-
-            /* Remove it completely */
-            error = path.RemoveAll();
+            error = SanitizeWhiteout(layer, entry, merge);
             if (error)
                 return error;
-
-            /* Opaque directory - hide entries in lower layers */
-            if (entry == ".wh..wh..opq") {
-                error = layer.SetXAttr("trusted.overlay.opaque", "y");
-                if (error)
-                    return error;
-            }
-
-            /* Metadata is done */
-            if (entry.compare(0, 8, ".wh..wh.") == 0)
-                continue;
-
-            /* Remove whiteouted entry */
-            path = layer / entry.substr(4);
-            if (path.Exists()) {
-                error = path.RemoveAll();
-                if (error)
-                    return error;
-            }
-
-            if (!merge) {
-                /* Convert into overlayfs whiteout */
-                error = path.Mknod(S_IFCHR, 0);
-                if (error)
-                    return error;
-            }
-
             continue;
         }
 
@@ -275,3 +988,59 @@ TError SanitizeLayer(TPath layer, bool merge) {
     }
     return TError::Success();
 }
+
+/*
+ * Handle only whiteouts from tar listing of extracted entries.
+ * Names with escaped characters cannot be trusted, scan whole layer then.
+ */
+TError SanitizeListedLayer(const TPath &layer, const TFile &list, bool merge) {
+    std::ifstream stream(list.ProcPath().ToString());
+    std::vector<std::string> whiteouts;
+    std::string name;
+    TError error;
+
+    if (!stream.is_open())
+        return SanitizeLayer(layer, merge);
+
+    while (std::getline(stream, name)) {
+        if (name.find('\\') != std::string::npos)
+            return SanitizeLayer(layer, merge);
+
+        while (name.size() > 1 && name.back() == '/')
+            name.pop_back();
+
+        auto sep = name.rfind('/');
+        std::string base = sep == std::string::npos ? name : name.substr(sep + 1);
+
+        if (base.compare(0, 4, ".wh.") == 0)
+            whiteouts.push_back(name);
+    }
+
+    if (stream.bad())
+        return SanitizeLayer(layer, merge);
+
+    TPath real = layer.RealPath();
+
+    for (auto &name: whiteouts) {
+        TPath entry = TPath(name).NormalPath();
+
+        if (entry.IsAbsolute() || entry.IsDotDot())
+            return SanitizeLayer(layer, merge);
+
+        /* Already removed with enclosing metadata directory */
+        TPath path = layer / entry;
+        if (!path.Exists())
+            continue;
+
+        /* Never follow symlinks extracted from tarball */
+        TPath dir = path.DirName();
+        if (dir.RealPath() != (real / entry.DirName()).NormalPath())
+            return SanitizeLayer(layer, merge);
+
+        error = SanitizeWhiteout(dir, path.BaseName(), merge);
+        if (error)
+            return error;
+    }
+
+    return TError::Success();
+}
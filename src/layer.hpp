@@ -1,5 +1,7 @@
 #pragma once
 
+#include <functional>
+
 #include "util/path.hpp"
 
 constexpr const char *LAYER_TMP_PREFIX = "_tmp_";
@@ -12,5 +14,22 @@ extern bool LayerIsJunk(const std::string &name);
 extern TError ImportLayer(const std::string &name, const TPath &place,
 			  const TPath &tarball, bool merge);
 extern TError RemoveLayer(const std::string &name, const TPath &place);
+extern void TouchLayer(const std::string &name, const TPath &place);
+extern TError CollectLayers(const TPath &place, bool dry_run,
+                            std::vector<std::string> &collected,
+                            uint64_t high, uint64_t low, uint64_t min_age);
 extern TError ValidateLayerName(const std::string &name);
 extern TError SanitizeLayer(TPath layer, bool merge);
+extern TError SanitizeListedLayer(const TPath &layer, const TFile &list, bool merge);
+
+extern void StartLayerWorkers();
+extern void StopLayerWorkers();
+extern void QueueLayerTask(const std::function<void()> &task);
+
+extern void StartLayerCollector();
+extern void StopLayerCollector();
+
+extern void StartReclaimer();
+extern void StopReclaimer();
+extern TError MoveToJunk(const TPath &place, const TPath &path);
+extern TError ClearToJunk(const TPath &place, const TPath &dir);
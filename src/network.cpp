@@ -7,9 +7,11 @@
 #include "container.hpp"
 #include "config.hpp"
 #include "client.hpp"
+#include "statistics.hpp"
 #include "util/log.hpp"
 #include "util/string.hpp"
 #include "util/crc32.hpp"
+#include "util/unix.hpp"
 
 extern "C" {
 #include <linux/if.h>
@@ -33,6 +35,8 @@ static TUintMap DeviceCeil;
 static TUintMap DeviceRateBurst;
 static TUintMap DeviceCeilBurst;
 static TUintMap DeviceQuantum;
+static TUintMap DeviceXPS;
+static TUintMap DeviceRPS;
 
 static TUintMap PortoRate;
 
@@ -45,6 +49,8 @@ static TUintMap ContainerRate;
 static TStringMap ContainerQdisc;
 static TUintMap ContainerQdiscLimit;
 
+static bool LinkStatsSupported = true;
+
 static inline std::unique_lock<std::mutex> LockNetworks() {
     return std::unique_lock<std::mutex>(NetworksMutex);
 }
@@ -56,6 +62,8 @@ TNetworkDevice::TNetworkDevice(struct rtnl_link *link) {
     Link = rtnl_link_get_link(link);
     Group = rtnl_link_get_group(link);
     MTU = rtnl_link_get_mtu(link);
+    TxQueues = rtnl_link_get_num_tx_queues(link);
+    RxQueues = rtnl_link_get_num_rx_queues(link);
 
     Rate = NET_MAX_RATE;
     Ceil = NET_MAX_RATE;
@@ -119,13 +127,51 @@ std::shared_ptr<TNetwork> TNetwork::GetNetwork(ino_t inode) {
     return nullptr;
 }
 
+/* Reuse connection to namespace if any, otherwise connect and remember it */
+TError TNetwork::OpenNetwork(TNamespaceFd &netns, std::shared_ptr<TNetwork> &net) {
+    ino_t inode = netns.GetInode();
+    TError error;
+
+    auto lock = LockNetworks();
+
+    auto it = Networks.find(inode);
+    if (it != Networks.end()) {
+        net = it->second.lock();
+        if (net)
+            return TError::Success();
+    }
+
+    net = std::make_shared<TNetwork>();
+
+    error = net->ConnectNetns(netns);
+    if (error) {
+        net = nullptr;
+        return error;
+    }
+
+    Networks[inode] = net;
+    lock.unlock();
+
+    auto netLock = net->ScopedLock();
+    error = net->RefreshDevices();
+    net->NewManagedDevices.clear();
+
+    return error;
+}
+
 void TNetwork::RefreshNetworks() {
+    std::vector<std::shared_ptr<TNetwork>> nets;
+
     auto lock = LockNetworks();
     for (auto &it: Networks) {
         auto net = it.second.lock();
         if (net)
-            net->RefreshClasses(false);
+            nets.push_back(net);
     }
+    lock.unlock();
+
+    for (auto &net: nets)
+        net->RefreshClasses(false);
 }
 
 void TNetwork::InitializeConfig() {
@@ -182,6 +228,10 @@ void TNetwork::InitializeConfig() {
         StringToUintMap(config().network().device_rate_burst(), DeviceRateBurst);
     if (config().network().has_device_ceil_burst())
         StringToUintMap(config().network().device_ceil_burst(), DeviceCeilBurst);
+    if (config().network().has_device_xps())
+        StringToUintMap(config().network().device_xps(), DeviceXPS);
+    if (config().network().has_device_rps())
+        StringToUintMap(config().network().device_rps(), DeviceRPS);
 
     if (config().network().has_default_qdisc())
         StringToStringMap(config().network().default_qdisc(), DefaultQdisc);
@@ -335,11 +385,61 @@ TError TNetwork::SetupQueue(TNetworkDevice &dev) {
         }
     }
 
+    SetupSteering(dev);
+
     dev.Prepared = true;
 
     return TError::Success();
 }
 
+/* Spread queues over cpus: queue N serves cpus N, N + queues, ... */
+static std::string QueueCpuMask(int queue, int queues) {
+    int cpus = GetNumCores();
+    std::string mask;
+
+    for (int word = (cpus + 31) / 32 - 1; word >= 0; word--) {
+        uint32_t bits = 0;
+        for (int bit = 0; bit < 32; bit++) {
+            int cpu = word * 32 + bit;
+            if (cpu < cpus && cpu % queues == queue)
+                bits |= 1u << bit;
+        }
+        if (mask.size())
+            mask += ",";
+        mask += StringFormat("%08x", bits);
+    }
+
+    return mask;
+}
+
+void TNetwork::SetupSteering(TNetworkDevice &dev) const {
+    TPath queues("/sys/class/net/" + dev.Name + "/queues");
+    TError error;
+
+    if (ManagedNamespace)
+        return;
+
+    if (dev.GetConfig(DeviceXPS)) {
+        for (int queue = 0; queue < dev.TxQueues; queue++) {
+            TPath knob = queues / ("tx-" + std::to_string(queue)) / "xps_cpus";
+            error = knob.WriteAll(QueueCpuMask(queue, dev.TxQueues));
+            if (error)
+                L_WRN() << "Cannot setup xps for " << dev.GetDesc()
+                        << ": " << error << std::endl;
+        }
+    }
+
+    if (dev.GetConfig(DeviceRPS)) {
+        for (int queue = 0; queue < dev.RxQueues; queue++) {
+            TPath knob = queues / ("rx-" + std::to_string(queue)) / "rps_cpus";
+            error = knob.WriteAll(QueueCpuMask(queue, dev.RxQueues));
+            if (error)
+                L_WRN() << "Cannot setup rps for " << dev.GetDesc()
+                        << ": " << error << std::endl;
+        }
+    }
+}
+
 TNetwork::TNetwork() : NatBitmap(0, 0) {
     Nl = std::make_shared<TNl>();
     PORTO_ASSERT(Nl != nullptr);
@@ -364,14 +464,27 @@ TError TNetwork::ConnectNetns(TNamespaceFd &netns) {
     if (error)
         return error;
 
+    Statistics->NetnsConnects++;
+
     error = Connect();
 
     TError error2 = my_netns.SetNs(CLONE_NEWNET);
     PORTO_ASSERT(!error2);
 
+    if (!error && &netns != &NetNs)
+        error = NetNs.Dup(netns);
+
     return error;
 }
 
+TError TNetwork::Reconnect() {
+    L() << "Reconnect netlink socket" << std::endl;
+    Nl->Disconnect();
+    if (NetNs.IsOpened())
+        return ConnectNetns(NetNs);
+    return Connect();
+}
+
 TError TNetwork::ConnectNew(TNamespaceFd &netns) {
     TNamespaceFd my_netns;
     TError error;
@@ -385,7 +498,10 @@ TError TNetwork::ConnectNew(TNamespaceFd &netns) {
 
     error = netns.Open(GetTid(), "ns/net");
     if (!error) {
+        Statistics->NetnsConnects++;
         error = Connect();
+        if (!error)
+            error = NetNs.Dup(netns);
         if (error)
             netns.Close();
     }
@@ -417,6 +533,13 @@ TError TNetwork::RefreshDevices() {
     int ret;
 
     ret = rtnl_link_alloc_cache(GetSock(), AF_UNSPEC, &cache);
+    if (ret < 0) {
+        L_WRN() << Nl->Error(ret, "Cannot allocate link cache") << std::endl;
+        error = Reconnect();
+        if (error)
+            return error;
+        ret = rtnl_link_alloc_cache(GetSock(), AF_UNSPEC, &cache);
+    }
     if (ret < 0)
         return Nl->Error(ret, "Cannot allocate link cache");
 
@@ -483,31 +606,76 @@ TError TNetwork::RefreshDevices() {
         error = SetupQueue(dev);
         if (error)
             return error;
-        NewManagedDevices = true;
+        if (std::find(NewManagedDevices.begin(), NewManagedDevices.end(),
+                      dev.Index) == NewManagedDevices.end())
+            NewManagedDevices.push_back(dev.Index);
     }
 
     return TError::Success();
 }
 
+/*
+ * Rebuild container classes on new devices, or on all devices if forced.
+ * Tc is programmed outside of ContainersMutex under per-container read
+ * locks; busy containers are left for the next refresh.
+ */
 TError TNetwork::RefreshClasses(bool force) {
+    std::vector<std::shared_ptr<TContainer>> containers;
+    std::vector<int> devices;
+    bool busy = false;
+
     auto netLock = ScopedLock();
     TError error = RefreshDevices();
-    if (error || (!force && !NewManagedDevices))
+    if (error || (!force && NewManagedDevices.empty()))
         return error;
-    NewManagedDevices = false;
+    devices.swap(NewManagedDevices);
     netLock.unlock();
 
     auto ctLock = LockContainers();
+    /* sorted by name, thus parents go first */
     for (auto &it: Containers) {
-        auto ct = it.second.get();
-        if (ct->Net.get() == this &&
+        auto &ct = it.second;
+        if ((ct->Controllers & CGROUP_NETCLS) &&
+            (ct->Net.get() == this || this == HostNetwork.get()) &&
             (ct->State == EContainerState::Running ||
-             ct->State == EContainerState::Meta)) {
-            error = ct->UpdateTrafficClasses();
+             ct->State == EContainerState::Meta))
+            containers.push_back(ct);
+    }
+    ctLock.unlock();
+
+    for (auto &ct: containers) {
+        ctLock.lock();
+        error = ct->LockRead(ctLock, true);
+        ctLock.unlock();
+        if (error) {
+            if (error.GetError() == EError::Busy)
+                busy = true;
+            continue;
+        }
+
+        if (ct->State == EContainerState::Running ||
+                ct->State == EContainerState::Meta) {
+            error = ct->UpdateTrafficClasses(this, force ? nullptr : &devices);
             if (error)
                 L_ERR() << "Cannot refresh tc for " << ct->Name << " : " << error << std::endl;
         }
+
+        ct->Unlock();
     }
+
+    if (busy) {
+        netLock.lock();
+        if (force) {
+            devices.clear();
+            for (auto &dev: Devices)
+                devices.push_back(dev.Index);
+        }
+        for (auto index: devices)
+            if (std::find(NewManagedDevices.begin(), NewManagedDevices.end(),
+                          index) == NewManagedDevices.end())
+                NewManagedDevices.push_back(index);
+    }
+
     L() << "done" << std::endl;
 
     return TError::Success();
@@ -693,47 +861,97 @@ std::string TNetwork::MatchDevice(const std::string &pattern) {
     return pattern;
 }
 
-TError TNetwork::GetDeviceStat(ENetStat kind, TUintMap &stat) {
+TError TNetwork::UpdateDeviceStat() {
+    uint64_t now = GetCurrentTimeMs();
     struct nl_cache *cache;
-    rtnl_link_stat_id_t id;
+    TError error;
 
-    switch (kind) {
-        case ENetStat::RxBytes:
-            id = RTNL_LINK_RX_BYTES;
-            break;
-        case ENetStat::RxPackets:
-            id = RTNL_LINK_RX_PACKETS;
-            break;
-        case ENetStat::RxDrops:
-            id = RTNL_LINK_RX_DROPPED;
-            break;
-        case ENetStat::TxBytes:
-            id = RTNL_LINK_TX_BYTES;
-            break;
-        case ENetStat::TxPackets:
-            id = RTNL_LINK_TX_PACKETS;
-            break;
-        case ENetStat::TxDrops:
-            id = RTNL_LINK_TX_DROPPED;
-            break;
-        default:
-            return TError(EError::Unknown, "Unsupported netlink statistics");
+    if (DeviceStatTime && now - DeviceStatTime <
+            config().network().device_stat_cache_ms())
+        return TError::Success();
+
+    if (LinkStatsSupported) {
+        DeviceStat.clear();
+        error = Nl->GetLinkStats(DeviceStat);
+        if (error) {
+            L_WRN() << "Cannot get link stats: " << error << std::endl;
+            error = Reconnect();
+            if (error)
+                return error;
+            DeviceStat.clear();
+            error = Nl->GetLinkStats(DeviceStat);
+        }
+        if (!error) {
+            DeviceStatTime = now;
+            return error;
+        }
+        /* Kernels older than 4.7 have no RTM_GETSTATS */
+        L_SYS() << "Fallback to link cache statistics: " << error << std::endl;
+        LinkStatsSupported = false;
     }
 
+    DeviceStat.clear();
+
     int ret = rtnl_link_alloc_cache(GetSock(), AF_UNSPEC, &cache);
     if (ret < 0)
         return Nl->Error(ret, "Cannot allocate link cache");
 
+    for (auto obj = nl_cache_get_first(cache); obj; obj = nl_cache_get_next(obj)) {
+        auto link = (struct rtnl_link *)obj;
+        auto &stat = DeviceStat[rtnl_link_get_ifindex(link)];
+
+        stat.RxPackets = rtnl_link_get_stat(link, RTNL_LINK_RX_PACKETS);
+        stat.RxBytes = rtnl_link_get_stat(link, RTNL_LINK_RX_BYTES);
+        stat.RxDrops = rtnl_link_get_stat(link, RTNL_LINK_RX_DROPPED);
+        stat.TxPackets = rtnl_link_get_stat(link, RTNL_LINK_TX_PACKETS);
+        stat.TxBytes = rtnl_link_get_stat(link, RTNL_LINK_TX_BYTES);
+        stat.TxDrops = rtnl_link_get_stat(link, RTNL_LINK_TX_DROPPED);
+    }
+
+    nl_cache_free(cache);
+
+    DeviceStatTime = now;
+    return TError::Success();
+}
+
+TError TNetwork::GetDeviceStat(ENetStat kind, TUintMap &stat) {
+    TError error;
+
+    error = UpdateDeviceStat();
+    if (error)
+        return error;
+
     for (auto &dev: Devices) {
-        auto link = rtnl_link_get(cache, dev.Index);
-        if (link)
-            stat[dev.Name] = rtnl_link_get_stat(link, id);
-        else
+        auto it = DeviceStat.find(dev.Index);
+        if (it == DeviceStat.end()) {
             L_WRN() << "Cannot find device " << dev.GetDesc() << std::endl;
-        rtnl_link_put(link);
+            continue;
+        }
+
+        switch (kind) {
+            case ENetStat::RxBytes:
+                stat[dev.Name] = it->second.RxBytes;
+                break;
+            case ENetStat::RxPackets:
+                stat[dev.Name] = it->second.RxPackets;
+                break;
+            case ENetStat::RxDrops:
+                stat[dev.Name] = it->second.RxDrops;
+                break;
+            case ENetStat::TxBytes:
+                stat[dev.Name] = it->second.TxBytes;
+                break;
+            case ENetStat::TxPackets:
+                stat[dev.Name] = it->second.TxPackets;
+                break;
+            case ENetStat::TxDrops:
+                stat[dev.Name] = it->second.TxDrops;
+                break;
+            default:
+                return TError(EError::Unknown, "Unsupported netlink statistics");
+        }
     }
 
-    nl_cache_free(cache);
     return TError::Success();
 }
 
@@ -797,7 +1015,8 @@ TError TNetwork::GetTrafficStat(uint32_t handle, ENetStat kind, TUintMap &stat)
 }
 
 TError TNetwork::CreateTC(uint32_t handle, uint32_t parent, bool leaf,
-                          TUintMap &prio, TUintMap &rate, TUintMap &ceil) {
+                          TUintMap &prio, TUintMap &rate, TUintMap &ceil,
+                          const std::vector<int> *devices) {
     TError error, result;
     TNlClass cls;
 
@@ -805,6 +1024,10 @@ TError TNetwork::CreateTC(uint32_t handle, uint32_t parent, bool leaf,
     cls.Handle = handle;
 
     for (auto &dev: Devices) {
+        if (devices && std::find(devices->begin(), devices->end(),
+                                 dev.Index) == devices->end())
+            continue;
+
         if (!dev.Managed)
             continue;
 
@@ -1376,7 +1599,7 @@ TError TNetCfg::ConfigureInterfaces() {
     if (error)
         return error;
 
-    Net->NewManagedDevices = false;
+    Net->NewManagedDevices.clear();
 
     for (auto &name: links) {
         if (!Net->DeviceIndex(name))
@@ -1458,7 +1681,7 @@ TError TNetCfg::PrepareNetwork() {
         error = Net->RefreshDevices();
         if (error)
             return error;
-        Net->NewManagedDevices = false;
+        Net->NewManagedDevices.clear();
 
         if (config().network().has_nat_first_ipv4())
             Net->NatBaseV4.Parse(AF_INET, config().network().nat_first_ipv4());
@@ -1477,21 +1700,9 @@ TError TNetCfg::PrepareNetwork() {
         if (error)
             return error;
 
-        Net = TNetwork::GetNetwork(NetNs.GetInode());
-        if (!Net) {
-            Net = std::make_shared<TNetwork>();
-
-            error = Net->ConnectNetns(NetNs);
-            if (error)
-                return error;
-
-            error = Net->RefreshDevices();
-            if (error)
-                return error;
-            Net->NewManagedDevices = false;
-
-            TNetwork::AddNetwork(NetNs.GetInode(), Net);
-        }
+        error = TNetwork::OpenNetwork(NetNs, Net);
+        if (error)
+            return error;
     } else if (NetCtName != "") {
         std::shared_ptr<TContainer> target;
         error = TContainer::Find(NetCtName, target);
@@ -36,6 +36,8 @@ public:
     int Link;
     int Group;
     int MTU;
+    int TxQueues;
+    int RxQueues;
     uint64_t Rate, Ceil;
     bool Managed;
     bool Prepared;
@@ -54,8 +56,15 @@ class TNetwork : public std::enable_shared_from_this<TNetwork>,
     std::shared_ptr<TNl> Nl;
     struct nl_sock *GetSock() const { return Nl->GetSock(); }
 
+    /* Pinned network namespace for reconnecting, empty for host */
+    TNamespaceFd NetNs;
+
     unsigned IfaceName = 0;
 
+    std::map<int, TNlLinkStat> DeviceStat;
+    uint64_t DeviceStatTime = 0;
+    TError UpdateDeviceStat();
+
 public:
     std::vector<TNetworkDevice> Devices;
 
@@ -63,7 +72,9 @@ public:
     TError RefreshClasses(bool force);
 
     bool ManagedNamespace = false;
-    bool NewManagedDevices = false;
+
+    /* Indexes of prepared devices without container classes */
+    std::vector<int> NewManagedDevices;
 
     int DeviceIndex(const std::string &name) {
         for (auto dev: Devices)
@@ -81,17 +92,20 @@ public:
     TError Connect();
     TError ConnectNetns(TNamespaceFd &netns);
     TError ConnectNew(TNamespaceFd &netns);
+    TError Reconnect();
     std::shared_ptr<TNl> GetNl() { return Nl; };
 
     TError Destroy();
 
     void GetDeviceSpeed(TNetworkDevice &dev) const;
     TError SetupQueue(TNetworkDevice &dev);
+    void SetupSteering(TNetworkDevice &dev) const;
 
     TError DelTC(const TNetworkDevice &dev, uint32_t handle) const;
 
     TError CreateTC(uint32_t handle, uint32_t parent, bool leaf,
-                    TUintMap &prio, TUintMap &rate, TUintMap &ceil);
+                    TUintMap &prio, TUintMap &rate, TUintMap &ceil,
+                    const std::vector<int> *devices = nullptr);
     TError DestroyTC(uint32_t handle);
 
     TError GetDeviceStat(ENetStat kind, TUintMap &stat);
@@ -110,6 +124,7 @@ public:
 
     static void AddNetwork(ino_t inode, std::shared_ptr<TNetwork> &net);
     static std::shared_ptr<TNetwork> GetNetwork(ino_t inode);
+    static TError OpenNetwork(TNamespaceFd &netns, std::shared_ptr<TNetwork> &net);
 
     static void InitializeConfig();
 
@@ -1216,6 +1216,13 @@ public:
             return EXIT_FAILURE;
         }
 
+        /* Cgroup v2 unified hierarchy is listed with empty controllers */
+        if (cgmap.find("freezer") == cgmap.end() && cgmap.count("")) {
+            cgmap["freezer"] = cgmap[""];
+            if (StringEndsWith(cgmap["freezer"], std::string("/") + PORTO_CGROUP_LEAF))
+                cgmap["freezer"] = TPath(cgmap["freezer"]).DirName().ToString();
+        }
+
         if (cgmap.find("freezer") == cgmap.end()) {
             std::cerr << "Process " << pid << " is not part of freezer cgroup" << std::endl;
             return EXIT_FAILURE;
@@ -1790,13 +1797,15 @@ public:
 class TLayerCmd final : public ICmd {
 public:
     TLayerCmd(Porto::Connection *api) : ICmd(api, "layer", 0,
-        "[-P <place>] -I|-M|-R|-L|-F|-E <layer> [tarball]",
+        "[-P <place>] -I|-M|-R|-L|-F|-G|-E <layer> [tarball]",
         "Manage overlayfs layers in internal storage",
         "    -P <place>               optional path to place\n"
         "    -I <layer> <tarball>     import layer from tarball\n"
         "    -M <layer> <tarball>     merge tarball into existing or new layer\n"
         "    -R <layer> [layer...]    remove layer from storage\n"
         "    -F                       remove all unused layes\n"
+        "    -G [-n]                  collect unused layers above space watermark\n"
+        "    -n                       dry run, only list layers for collection\n"
         "    -L                       list present layers\n"
         "    -E <volume> <tarball>    export upper layer into tarball\n"
         ) {}
@@ -1807,6 +1816,8 @@ public:
     bool list   = false;
     bool export_ = false;
     bool flush = false;
+    bool collect = false;
+    bool dry_run = false;
     std::string place;
 
     int Execute(TCommandEnviroment *env) final override {
@@ -1817,6 +1828,8 @@ public:
             { 'M', false, [&](const char *arg) { merge  = true; } },
             { 'R', false, [&](const char *arg) { remove = true; } },
             { 'F', false, [&](const char *arg) { flush  = true; } },
+            { 'G', false, [&](const char *arg) { collect = true; } },
+            { 'n', false, [&](const char *arg) { dry_run = true; } },
             { 'L', false, [&](const char *arg) { list   = true; } },
             { 'E', false, [&](const char *arg) { export_= true; } },
         });
@@ -1862,6 +1875,15 @@ public:
                 for (const auto &l: layers)
                     (void)Api->RemoveLayer(l, place);
             }
+        } else if (collect) {
+            std::vector<std::string> layers;
+            ret = Api->CollectLayers(layers, dry_run, place);
+            if (ret) {
+                PrintError("Can't collect layers");
+            } else {
+                for (const auto &l: layers)
+                    std::cout << l << std::endl;
+            }
         } else if (list) {
             std::vector<std::string> layers;
             ret = Api->ListLayers(layers, place);
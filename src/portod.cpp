@@ -16,6 +16,8 @@
 #include "epoll.hpp"
 #include "container.hpp"
 #include "volume.hpp"
+#include "layer.hpp"
+#include "task.hpp"
 #include "protobuf.hpp"
 #include "util/log.hpp"
 #include "util/signal.hpp"
@@ -47,6 +49,7 @@ std::string PreviousVersion;
 
 std::unique_ptr<TEpollLoop> EpollLoop;
 std::unique_ptr<TEventQueue> EventQueue;
+std::unique_ptr<TEventQueue> FreezerQueue;
 
 static pid_t slavePid;
 static bool stdlog = false;
@@ -128,6 +131,7 @@ static void DaemonShutdown(bool master, int ret) {
 struct TRequest {
     std::shared_ptr<TClient> Client;
     rpc::TContainerRequest Request;
+    std::function<void()> Task;     /* continuation of queued request */
 };
 
 class TRpcWorker : public TWorker<TRequest> {
@@ -139,6 +143,11 @@ public:
     }
 
     bool Handle(const TRequest &request) override {
+        if (request.Task) {
+            request.Task();
+            return true;
+        }
+
         HandleRpcRequest(request.Request, request.Client);
         Statistics->RequestsCompleted++;
         Statistics->RequestsQueued--;
@@ -147,6 +156,35 @@ public:
     }
 };
 
+static TRpcWorker *RpcWorker;
+
+void QueueRpcTask(const std::function<void()> &task) {
+    TRequest req;
+    req.Task = task;
+    RpcWorker->Push(req);
+}
+
+/* Shared by all bulk requests, each keeps at most its own limit queued */
+class TBulkWorker : public TWorker<std::function<void()>> {
+public:
+    TBulkWorker(const size_t nr) : TWorker("portod-bulk", nr) {}
+
+    const std::function<void()> &Top() override {
+        return Queue.front();
+    }
+
+    bool Handle(const std::function<void()> &task) override {
+        task();
+        return true;
+    }
+};
+
+static TBulkWorker *BulkWorker;
+
+void QueueBulkTask(const std::function<void()> &task) {
+    BulkWorker->Push(task);
+}
+
 static TError CreatePortoSocket() {
     TPath path(PORTO_SOCKET_PATH);
     struct sockaddr_un addr;
@@ -274,6 +312,7 @@ retry:
 
 static int SlaveRpc() {
     TRpcWorker worker(config().daemon().workers());
+    TBulkWorker bulk_worker(std::max(1u, config().daemon().bulk_threads()));
     int ret = 0;
     std::map<int, std::shared_ptr<TClient>> clients;
     bool accept_paused = false;
@@ -305,8 +344,18 @@ static int SlaveRpc() {
 
     std::vector<struct epoll_event> events;
 
+    RpcWorker = &worker;
     worker.Start();
+    BulkWorker = &bulk_worker;
+    bulk_worker.Start();
+    StartLayerWorkers();
+    StartReclaimer();
+    StartGuaranteeSampler();
+    StartQuotaWorkers();
+    StartLayerCollector();
+    StartCgroupPool();
     EventQueue->Start();
+    FreezerQueue->Start();
 
     bool discardState = false;
     while (true) {
@@ -436,8 +485,16 @@ static int SlaveRpc() {
     }
 
 exit:
+    FreezerQueue->Stop();
     EventQueue->Stop();
     worker.Stop();
+    bulk_worker.Stop();
+    StopLayerWorkers();
+    StopReclaimer();
+    StopGuaranteeSampler();
+    StopQuotaWorkers();
+    StopLayerCollector();
+    StopCgroupPool();
 
     for (auto c : clients)
         c.second->CloseConnection();
@@ -507,6 +564,10 @@ static TError CreateRootContainer() {
     if (error)
         return error;
 
+    error = ContainerIdMap.GetAt(INGRESS_CONTAINER_ID);
+    if (error)
+        return error;
+
     //ScheduleLogRotatation();
 
     return TError::Success();
@@ -716,6 +777,17 @@ static int SlaveMain() {
     TNetwork::InitializeConfig();
     InitContainerProperties();
 
+    error = SetupRootTemplate();
+    if (error)
+        L_WRN() << "Cannot setup root template: " << error << std::endl;
+
+    /* Must be forked before any threads */
+    if (config().daemon().spawner()) {
+        error = StartSpawner();
+        if (error)
+            L_ERR() << "Cannot start spawner: " << error << std::endl;
+    }
+
     ContainersKV = TPath(config().keyval().file().path());
     error = TKeyValue::Mount(ContainersKV);
     if (error)
@@ -727,7 +799,10 @@ static int SlaveMain() {
         FatalError("Cannot mount volumes keyvalue", error);
 
     EpollLoop = std::unique_ptr<TEpollLoop>(new TEpollLoop());
-    EventQueue = std::unique_ptr<TEventQueue>(new TEventQueue());
+    EventQueue = std::unique_ptr<TEventQueue>(new TEventQueue("portod-event",
+                                config().daemon().event_workers()));
+    /* Never locks containers: events are not stuck behind locked ones */
+    FreezerQueue = std::unique_ptr<TEventQueue>(new TEventQueue("portod-freezer", 1));
 
     error = EpollLoop->Create();
     if (error)
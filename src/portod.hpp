@@ -5,3 +5,4 @@ class TEventQueue;
 
 extern std::unique_ptr<TEpollLoop> EpollLoop;
 extern std::unique_ptr<TEventQueue> EventQueue;
+extern std::unique_ptr<TEventQueue> FreezerQueue;
@@ -91,6 +91,7 @@ TError TProperty::IsRunning(void) {
 }
 
 TError TProperty::WantControllers(uint64_t controllers) const {
+    controllers &= SupportedControllers;
     if (CurrentContainer->State == EContainerState::Stopped) {
         CurrentContainer->Controllers |= controllers;
         CurrentContainer->RequiredControllers |= controllers;
@@ -567,6 +568,7 @@ TError TMemoryGuarantee::Set(const std::string &mem_guarantee) {
         return error;
 
     CurrentContainer->NewMemGuarantee = new_val;
+    CurrentContainer->UpdateTotalMemGuarantee();
 
     uint64_t total = GetTotalMemory();
     uint64_t usage = RootContainer->GetTotalMemGuarantee();
@@ -574,6 +576,7 @@ TError TMemoryGuarantee::Set(const std::string &mem_guarantee) {
 
     if (usage + reserve > total) {
         CurrentContainer->NewMemGuarantee = CurrentContainer->MemGuarantee;
+        CurrentContainer->UpdateTotalMemGuarantee();
         int64_t left = total - reserve - RootContainer->GetTotalMemGuarantee();
         return TError(EError::ResourceNotAvailable, "Only " + std::to_string(left) + " bytes left");
     }
@@ -1016,6 +1019,9 @@ public:
             return error;
         if ((val & CurrentContainer->RequiredControllers) != CurrentContainer->RequiredControllers)
             return TError(EError::InvalidValue, "Cannot disable required controllers");
+        if (val & ~SupportedControllers)
+            return TError(EError::NotSupported, "Unsupported controllers: " +
+                          StringFormatFlags(val & ~SupportedControllers, ControllersName));
         CurrentContainer->Controllers = val;
         CurrentContainer->SetProp(EProperty::CONTROLLERS);
         return TError::Success();
@@ -1043,6 +1049,9 @@ public:
             val = CurrentContainer->Controllers & ~val;
         if ((val & CurrentContainer->RequiredControllers) != CurrentContainer->RequiredControllers)
             return TError(EError::InvalidValue, "Cannot disable required controllers");
+        if (val & ~SupportedControllers)
+            return TError(EError::NotSupported, "Unsupported controllers: " +
+                          StringFormatFlags(val & ~SupportedControllers, ControllersName));
         CurrentContainer->Controllers = val;
         CurrentContainer->SetProp(EProperty::CONTROLLERS);
         return TError::Success();
@@ -2760,6 +2769,31 @@ TError TIoOps::GetIndexed(const std::string &index,
     return TError::Success();
 }
 
+class TStartTimings : public TProperty {
+public:
+    TError Get(std::string &value);
+    TError GetIndexed(const std::string &index, std::string &value);
+    TStartTimings() : TProperty(D_START_TIMINGS, EProperty::NONE,
+                                "duration of last start stages [us] (ro)") {
+        IsReadOnly = true;
+    }
+} static StartTimings;
+
+TError TStartTimings::Get(std::string &value) {
+    return UintMapToString(CurrentContainer->StartTimings, value);
+}
+
+TError TStartTimings::GetIndexed(const std::string &index,
+                                 std::string &value) {
+    auto it = CurrentContainer->StartTimings.find(index);
+    if (it == CurrentContainer->StartTimings.end())
+        return TError(EError::InvalidValue, "Invalid subscript for property");
+
+    value = std::to_string(it->second);
+
+    return TError::Success();
+}
+
 class TTime : public TProperty {
 public:
     TError Get(std::string &value);
@@ -2851,6 +2885,36 @@ void TPortoStat::Populate(TUintMap &m) {
 
     m["requests_queued"] = Statistics->RequestsQueued;
     m["requests_completed"] = Statistics->RequestsCompleted;
+
+    m["netns_connects"] = Statistics->NetnsConnects;
+    m["layer_tasks_queued"] = Statistics->LayerTasksQueued;
+    m["layers_imported"] = Statistics->LayersImported;
+    m["layers_exported"] = Statistics->LayersExported;
+    m["layer_dedup_files"] = Statistics->LayerDedupFiles;
+    m["layer_dedup_bytes"] = Statistics->LayerDedupBytes;
+    m["junk_queued"] = Statistics->JunkQueued;
+    m["junk_reclaimed"] = Statistics->JunkReclaimed;
+    m["junk_files_removed"] = Statistics->JunkFilesRemoved;
+    m["quota_inodes_assigned"] = Statistics->QuotaInodesAssigned;
+    m["guarantee_samples"] = Statistics->GuaranteeSamples;
+    m["layer_gc_runs"] = Statistics->LayerGcRuns;
+    m["layers_collected"] = Statistics->LayersCollected;
+    m["layers_collected_bytes"] = Statistics->LayersCollectedBytes;
+    m["tasks_spawned"] = Statistics->TasksSpawned;
+    m["cgroups_pooled"] = Statistics->CgroupsPooled;
+    m["cgroups_recycled"] = Statistics->CgroupsRecycled;
+
+    uint64_t starts = 0;
+    for (int i = 0; i < START_LATENCY_BUCKETS; i++) {
+        starts += Statistics->StartLatency[i];
+        if (i < START_LATENCY_BUCKETS - 1)
+            m["start_latency_le_" + std::to_string(StartLatencyBuckets[i]) + "ms"] = starts;
+        else
+            m["start_latency_le_inf"] = starts;
+    }
+
+    for (unsigned i = 0; i < StartStages.size() && i < START_STAGES_MAX; i++)
+        m["start_" + StartStages[i] + "_us"] = Statistics->StartStageUs[i];
 }
 
 TError TPortoStat::Get(std::string &value) {
@@ -94,6 +94,7 @@ constexpr const char *D_IO_READ = "io_read";
 constexpr const char *D_IO_WRITE = "io_write";
 constexpr const char *D_IO_OPS = "io_ops";
 constexpr const char *D_TIME = "time";
+constexpr const char *D_START_TIMINGS = "start_timings";
 constexpr const char *D_PORTO_STAT = "porto_stat";
 constexpr const char *D_MEM_TOTAL_LIMIT = "memory_limit_total";
 constexpr const char *D_CGROUPS = "cgroups";
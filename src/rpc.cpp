@@ -1,4 +1,6 @@
 #include <algorithm>
+#include <deque>
+#include <mutex>
 
 #include "rpc.hpp"
 #include "config.hpp"
@@ -13,6 +15,7 @@
 #include "util/log.hpp"
 #include "util/string.hpp"
 #include "util/cred.hpp"
+#include "statistics.hpp"
 #include "portod.hpp"
 
 static std::string RequestAsString(const rpc::TContainerRequest &req) {
@@ -52,6 +55,20 @@ static std::string RequestAsString(const rpc::TContainerRequest &req) {
         return "start " + req.start().name();
     else if (req.has_stop())
         return "stop " + req.stop().name();
+    else if (req.has_bulk()) {
+        std::string ret = req.bulk().stop() ? "bulk stop" : "bulk start";
+
+        for (int i = 0; i < req.bulk().name_size(); i++)
+            ret += " " + req.bulk().name(i);
+
+        if (req.bulk().has_subtree())
+            ret += " subtree " + req.bulk().subtree();
+
+        if (req.bulk().has_state())
+            ret += " state " + req.bulk().state();
+
+        return ret;
+    }
     else if (req.has_pause())
         return "pause " + req.pause().name();
     else if (req.has_resume())
@@ -150,6 +167,10 @@ static std::string ResponseAsString(const rpc::TContainerResponse &resp) {
                 ret = "Wait " + resp.wait().name();
         } else if (resp.has_convertpath())
             ret = resp.convertpath().path();
+        else if (resp.has_bulk())
+            ret = std::to_string(resp.bulk().result_size()) + " containers, " +
+                  std::to_string(resp.bulk().failed()) + " failed in " +
+                  std::to_string(resp.bulk().time_ms()) + " ms";
         else
             ret = "Ok";
         return ret;
@@ -244,6 +265,7 @@ static bool ValidRequest(const rpc::TContainerRequest &req) {
         req.has_get() +
         req.has_start() +
         req.has_stop() +
+        req.has_bulk() +
         req.has_pause() +
         req.has_resume() +
         req.has_propertylist() +
@@ -261,6 +283,7 @@ static bool ValidRequest(const rpc::TContainerRequest &req) {
         req.has_exportlayer() +
         req.has_removelayer() +
         req.has_listlayers() +
+        req.has_collectlayers() +
         req.has_convertpath() == 1;
 }
 
@@ -310,12 +333,77 @@ static noinline TError CreateContainer(std::string reqName, bool weak,
     return error;
 }
 
+/* Freezer v1 has no notifications, waiting for it would hold rpc worker */
+static bool MayQueueFreeze(TContainer &ct) {
+    if (CgroupV2 || !(ct.Controllers & CGROUP_FREEZER) ||
+            ct.State == EContainerState::Stopped)
+        return false;
+    auto cg = ct.GetCgroup(FreezerSubsystem);
+    return !FreezerSubsystem.IsFrozen(cg) && !cg.IsEmpty();
+}
+
+/*
+ * Start freezing and release rpc worker, container stays write-locked.
+ * Freezer queue polls state with backoff, then rpc worker finishes action,
+ * unlocks container and sends reply. With force action is done even if
+ * freezing timed out: terminate falls back to killing unfrozen tasks.
+ */
+static TError QueueFreezeReply(std::shared_ptr<TClient> &client,
+                               std::shared_ptr<TContainer> &ct, bool force,
+                               const std::function<TError(TContainer &)> &action) {
+    auto cg = ct->GetCgroup(FreezerSubsystem);
+    std::string state;
+
+    TError error = FreezerSubsystem.Freeze(cg, false);
+    if (error || (!FreezerSubsystem.GetState(cg, state) && state == "FROZEN"))
+        return action(*ct);
+
+    /* Lock is counter, not owned by thread: continuation unlocks it */
+    client->LockedContainer = nullptr;
+
+    TEvent e(EEventType::FreezerWait, ct);
+    e.FreezerWait.Cgroup = cg.Name;
+    e.FreezerWait.DeadlineMs = GetCurrentTimeMs() +
+        config().daemon().freezer_wait_timeout_s() * 1000;
+    e.FreezerWait.BackoffMs = 1;
+    e.FreezerWait.Continue = [client, ct, cg, force, action] (const TError &frozen) {
+        QueueRpcTask([client, ct, cg, force, action, frozen] () {
+            rpc::TContainerResponse rsp;
+            TError error = frozen;
+
+            if (error) {
+                TCgroup freezer = cg;
+                (void)FreezerSubsystem.Thaw(freezer, false);
+            }
+
+            if (!error || force) {
+                CurrentClient = client.get();
+                error = action(*ct);
+                CurrentClient = nullptr;
+            }
+
+            ct->Unlock();
+
+            rsp.set_error(error.GetError());
+            rsp.set_errormsg(error.GetMsg());
+            SendReply(*client, rsp, true);
+        });
+    };
+    FreezerQueue->Add(e.FreezerWait.BackoffMs, e);
+
+    return TError::Queued();
+}
+
 noinline TError DestroyContainer(const rpc::TContainerDestroyRequest &req,
-                                 rpc::TContainerResponse &rsp) {
+                                 std::shared_ptr<TClient> &client) {
     std::shared_ptr<TContainer> ct;
     TError error = CurrentClient->WriteContainer(req.name(), ct);
     if (error)
         return error;
+    if (MayQueueFreeze(*ct))
+        return QueueFreezeReply(client, ct, true, [] (TContainer &ct) {
+            return ct.Destroy();
+        });
     return ct->Destroy();
 }
 
@@ -329,23 +417,260 @@ noinline TError StartContainer(const rpc::TContainerStartRequest &req,
 }
 
 noinline TError StopContainer(const rpc::TContainerStopRequest &req,
-                              rpc::TContainerResponse &rsp) {
+                              std::shared_ptr<TClient> &client) {
     std::shared_ptr<TContainer> ct;
     TError error = CurrentClient->WriteContainer(req.name(), ct);
     if (error)
         return error;
     uint64_t timeout_ms = req.has_timeout_ms() ?
         req.timeout_ms() : config().container().stop_timeout_ms();
+    /* Graceful stop needs running tasks for SIGTERM */
+    if (!timeout_ms && MayQueueFreeze(*ct))
+        return QueueFreezeReply(client, ct, true, [] (TContainer &ct) {
+            return ct.Stop(0);
+        });
     return ct->Stop(timeout_ms);
 }
 
+struct TBulkTask {
+    std::shared_ptr<TContainer> Container;
+    std::string Name;               /* relative for client */
+    TBulkTask *Parent = nullptr;    /* nearest ancestor in request */
+    std::vector<TBulkTask *> Children;
+    size_t Pending = 0;
+    TError Error;
+    uint64_t TimeMs = 0;
+};
+
+struct TBulkRequest {
+    std::shared_ptr<TClient> Client;
+    bool Stop;
+    uint64_t TimeoutMs;
+    uint64_t StartMs;
+    size_t Threads;
+    size_t Running = 0;
+    size_t Done = 0;
+    std::map<std::string, TBulkTask> Tasks;
+    std::deque<TBulkTask *> Ready;
+    std::mutex Mutex;
+};
+
+static void RunBulkTask(TBulkTask &task, bool stop, uint64_t timeout_ms) {
+    uint64_t start = GetCurrentTimeMs();
+    auto ct = task.Container;
+
+    if (!stop && task.Parent && task.Parent->Error) {
+        task.Error = TError(EError::InvalidState, "Parent start failed: " +
+                            task.Parent->Name);
+        return;
+    }
+
+    auto lock = LockContainers();
+    task.Error = ct->Lock(lock);
+    lock.unlock();
+
+    if (!task.Error) {
+        if (stop)
+            task.Error = ct->Stop(timeout_ms);
+        else
+            task.Error = ct->Start();
+        ct->Unlock();
+    }
+
+    task.TimeMs = GetCurrentTimeMs() - start;
+}
+
+static void BulkResponse(TBulkRequest &bulk, rpc::TContainerResponse &rsp) {
+    auto result = rsp.mutable_bulk();
+    unsigned failed = 0;
+
+    for (auto &it: bulk.Tasks) {
+        auto &task = it.second;
+        auto res = result->add_result();
+
+        res->set_name(task.Name);
+        res->set_error(task.Error.GetError());
+        if (task.Error) {
+            res->set_errormsg(task.Error.GetMsg());
+            failed++;
+        }
+        res->set_time_ms(task.TimeMs);
+    }
+
+    result->set_failed(failed);
+    result->set_time_ms(GetCurrentTimeMs() - bulk.StartMs);
+
+    L_ACT() << (bulk.Stop ? "Bulk stop " : "Bulk start ") << bulk.Tasks.size()
+            << " containers on " << bulk.Threads << " threads, " << failed
+            << " failed, " << result->time_ms() << " ms" << std::endl;
+}
+
+static void QueueBulkTasks(std::shared_ptr<TBulkRequest> &bulk);
+
+static void HandleBulkTask(std::shared_ptr<TBulkRequest> bulk, TBulkTask *task) {
+    CurrentClient = bulk->Client.get();
+    RunBulkTask(*task, bulk->Stop, bulk->TimeoutMs);
+    CurrentClient = nullptr;
+
+    std::unique_lock<std::mutex> lock(bulk->Mutex);
+
+    bulk->Running--;
+    bulk->Done++;
+
+    if (bulk->Stop) {
+        if (task->Parent && !--task->Parent->Pending)
+            bulk->Ready.push_back(task->Parent);
+    } else {
+        for (auto child: task->Children)
+            if (!--child->Pending)
+                bulk->Ready.push_back(child);
+    }
+
+    if (bulk->Done < bulk->Tasks.size()) {
+        QueueBulkTasks(bulk);
+        return;
+    }
+
+    lock.unlock();
+
+    rpc::TContainerResponse rsp;
+    BulkResponse(*bulk, rsp);
+    rsp.set_error(EError::Success);
+    SendReply(*bulk->Client, rsp, true);
+}
+
+/* Called under request mutex, keeps at most Threads tasks in shared pool */
+static void QueueBulkTasks(std::shared_ptr<TBulkRequest> &bulk) {
+    while (bulk->Running < bulk->Threads && !bulk->Ready.empty()) {
+        TBulkTask *task = bulk->Ready.front();
+        bulk->Ready.pop_front();
+        bulk->Running++;
+        QueueBulkTask([bulk, task] () {
+            HandleBulkTask(bulk, task);
+        });
+    }
+}
+
+/*
+ * Start (or stop) set of containers in shared pool of bulk workers.
+ * Container starts after nearest ancestor from the same request,
+ * for stop order is reversed. Each container is locked separately
+ * as in regular start/stop thus independent branches run in parallel.
+ * Reply is sent when the last container is done.
+ */
+noinline TError BulkContainers(const rpc::TContainerBulkRequest &req,
+                               rpc::TContainerResponse &rsp,
+                               std::shared_ptr<TClient> &client) {
+    auto bulk = std::make_shared<TBulkRequest>();
+    auto &tasks = bulk->Tasks;
+    TError error;
+
+    bulk->Client = client;
+    bulk->StartMs = GetCurrentTimeMs();
+    bulk->Stop = req.has_stop() && req.stop();
+    bulk->TimeoutMs = req.has_timeout_ms() ?
+        req.timeout_ms() : config().container().stop_timeout_ms();
+
+    bool stop = bulk->Stop;
+
+    error = CheckPortoWriteAccess();
+    if (error)
+        return error;
+
+    auto lock = LockContainers();
+
+    auto add = [&](std::shared_ptr<TContainer> ct, bool implicit) -> TError {
+        if (ct->IsRoot())
+            return TError(EError::Permission, "Root container is read-only");
+
+        if (req.has_state()) {
+            if (TContainer::StateName(ct->State) != req.state())
+                return TError::Success();
+        } else if (implicit && (ct->State == EContainerState::Stopped) != stop)
+            return TError::Success();
+
+        TError error = client->CanControl(*ct);
+        if (error)
+            return error;
+
+        auto &task = tasks[ct->Name];
+        task.Container = ct;
+        return client->ComposeName(ct->Name, task.Name);
+    };
+
+    for (auto &name: req.name()) {
+        std::shared_ptr<TContainer> ct;
+        error = client->ResolveContainer(name, ct);
+        if (!error)
+            error = add(ct, false);
+        if (error)
+            return error;
+    }
+
+    if (req.has_subtree()) {
+        std::shared_ptr<TContainer> root;
+        error = client->ResolveContainer(req.subtree(), root);
+        if (error)
+            return error;
+        for (auto &ct: root->Subtree()) {
+            if (ct->IsRoot())
+                continue;
+            error = add(ct, true);
+            if (error)
+                return error;
+        }
+    }
+
+    lock.unlock();
+
+    for (auto &it: tasks) {
+        auto &task = it.second;
+        for (auto ct = task.Container->GetParent(); ct; ct = ct->GetParent()) {
+            auto parent = tasks.find(ct->Name);
+            if (parent != tasks.end()) {
+                task.Parent = &parent->second;
+                task.Parent->Children.push_back(&task);
+                break;
+            }
+        }
+    }
+
+    for (auto &it: tasks) {
+        auto &task = it.second;
+        task.Pending = stop ? task.Children.size() : (task.Parent ? 1 : 0);
+        if (!task.Pending)
+            bulk->Ready.push_back(&task);
+    }
+
+    size_t nr_threads = config().daemon().bulk_threads();
+    if (req.has_threads() && req.threads())
+        nr_threads = std::min(nr_threads, (size_t)req.threads());
+    bulk->Threads = std::max(std::min(nr_threads, tasks.size()), (size_t)1);
+
+    if (tasks.empty()) {
+        BulkResponse(*bulk, rsp);
+        return TError::Success();
+    }
+
+    std::unique_lock<std::mutex> bulk_lock(bulk->Mutex);
+    QueueBulkTasks(bulk);
+
+    return TError::Queued();
+}
+
 noinline TError PauseContainer(const rpc::TContainerPauseRequest &req,
-                               rpc::TContainerResponse &rsp) {
+                               std::shared_ptr<TClient> &client) {
     std::shared_ptr<TContainer> ct;
     TError error = CurrentClient->WriteContainer(req.name(), ct);
     if (error)
         return error;
 
+    if ((ct->State == EContainerState::Running ||
+                ct->State == EContainerState::Meta) && MayQueueFreeze(*ct))
+        return QueueFreezeReply(client, ct, false, [] (TContainer &ct) {
+            return ct.Pause();
+        });
+
     return ct->Pause();
 }
 
@@ -789,21 +1114,31 @@ noinline TError ListVolumes(const rpc::TVolumeListRequest &req,
         return TError::Success();
     }
 
-    auto volumes_lock = LockVolumes();
     std::list<std::pair<TPath, std::shared_ptr<TVolume>>> list;
-    for (auto &it : Volumes) {
-        auto volume = it.second;
-
-        if (req.has_container() &&
-                std::find(volume->Containers.begin(), volume->Containers.end(),
-                    req.container()) == volume->Containers.end())
-            continue;
 
-        TPath path = container_root.InnerPath(volume->Path, true);
-        if (!path.IsEmpty())
-            list.push_back(std::make_pair(path, volume));
+    if (req.has_container()) {
+        /* Linked volumes are indexed in container */
+        auto containers_lock = LockContainers();
+        auto ct = TContainer::Find(req.container());
+        containers_lock.unlock();
+
+        if (ct) {
+            auto volumes_lock = LockVolumes();
+            for (auto &volume: ct->Volumes) {
+                TPath path = container_root.InnerPath(volume->Path, true);
+                if (!path.IsEmpty())
+                    list.push_back(std::make_pair(path, volume));
+            }
+        }
+    } else {
+        auto volumes_lock = LockVolumes();
+        for (auto &it : Volumes) {
+            auto volume = it.second;
+            TPath path = container_root.InnerPath(volume->Path, true);
+            if (!path.IsEmpty())
+                list.push_back(std::make_pair(path, volume));
+        }
     }
-    volumes_lock.unlock();
 
     for (auto &it: list) {
         auto desc = rsp.mutable_volumelist()->add_volumes();
@@ -813,7 +1148,20 @@ noinline TError ListVolumes(const rpc::TVolumeListRequest &req,
     return TError::Success();
 }
 
-noinline TError ImportLayer(const rpc::TLayerImportRequest &req) {
+/* Long layer operations are done by layer workers, reply is sent from there */
+static void QueueLayerReply(std::shared_ptr<TClient> &client,
+                            const std::function<TError(rpc::TContainerResponse &)> &fn) {
+    QueueLayerTask([client, fn] () {
+        rpc::TContainerResponse rsp;
+        TError error = fn(rsp);
+        rsp.set_error(error.GetError());
+        rsp.set_errormsg(error.GetMsg());
+        SendReply(*client, rsp, true);
+    });
+}
+
+noinline TError ImportLayer(const rpc::TLayerImportRequest &req,
+                            std::shared_ptr<TClient> &client) {
     TError error = CheckPortoWriteAccess();
     if (error)
         return error;
@@ -839,10 +1187,21 @@ noinline TError ImportLayer(const rpc::TLayerImportRequest &req) {
     if (!tarball.CanRead(CurrentClient->Cred))
         return TError(EError::Permission, "client has not read access to tarball");
 
-    return ImportLayer(req.layer(), place, tarball, req.merge());
+    std::string name = req.layer();
+    bool merge = req.merge();
+
+    QueueLayerReply(client, [name, place, tarball, merge] (rpc::TContainerResponse &) {
+        TError error = ImportLayer(name, place, tarball, merge);
+        if (!error)
+            Statistics->LayersImported++;
+        return error;
+    });
+
+    return TError::Queued();
 }
 
-noinline TError ExportLayer(const rpc::TLayerExportRequest &req) {
+noinline TError ExportLayer(const rpc::TLayerExportRequest &req,
+                            std::shared_ptr<TClient> &client) {
     TError error = CheckPortoWriteAccess();
     if (error)
         return error;
@@ -873,19 +1232,21 @@ noinline TError ExportLayer(const rpc::TLayerExportRequest &req) {
     if (error)
         return error;
 
-    error = PackTarball(tarball, upper);
-    if (error) {
-        (void)tarball.Unlink();
-        return error;
-    }
+    TCred cred = CurrentClient->Cred;
 
-    error = tarball.Chown(CurrentClient->Cred);
-    if (error) {
-        (void)tarball.Unlink();
-        return error;
-    }
+    QueueLayerReply(client, [tarball, upper, cred] (rpc::TContainerResponse &) {
+        TError error = PackTarball(tarball, upper);
+        if (!error)
+            error = tarball.Chown(cred);
+        if (error) {
+            (void)tarball.Unlink();
+            return error;
+        }
+        Statistics->LayersExported++;
+        return TError::Success();
+    });
 
-    return TError::Success();
+    return TError::Queued();
 }
 
 noinline TError RemoveLayer(const rpc::TLayerRemoveRequest &req) {
@@ -918,6 +1279,44 @@ noinline TError ListLayers(const rpc::TLayerListRequest &req,
     return error;
 }
 
+noinline TError CollectLayers(const rpc::TLayerCollectRequest &req,
+                              std::shared_ptr<TClient> &client) {
+    TError error = CheckPortoWriteAccess();
+    if (error)
+        return error;
+
+    TPath place(req.has_place() ? req.place() : config().volumes().default_place());
+    error = CheckPlace(place);
+    if (error)
+        return error;
+
+    uint64_t high = req.has_high_watermark() ? req.high_watermark() :
+                    config().volumes().layer_gc_high_watermark();
+    if (!high && !req.has_high_watermark())
+        return TError::Success();
+
+    bool dry_run = req.dry_run();
+    uint64_t low = req.has_low_watermark() ? req.low_watermark() :
+                   config().volumes().layer_gc_low_watermark();
+    uint64_t min_age = req.has_min_age() ? req.min_age() :
+                       config().volumes().layer_gc_min_age();
+
+    QueueLayerReply(client, [place, dry_run, high, low, min_age]
+                            (rpc::TContainerResponse &rsp) {
+        std::vector<std::string> collected;
+        TError error = CollectLayers(place, dry_run, collected,
+                                     high, low, min_age);
+        if (!error) {
+            auto list = rsp.mutable_layers();
+            for (auto &layer: collected)
+                list->add_layer(layer);
+        }
+        return error;
+    });
+
+    return TError::Queued();
+}
+
 void HandleRpcRequest(const rpc::TContainerRequest &req,
                       std::shared_ptr<TClient> client) {
     rpc::TContainerResponse rsp;
@@ -942,7 +1341,7 @@ void HandleRpcRequest(const rpc::TContainerRequest &req,
         else if (req.has_createweak())
             error = CreateContainer(req.createweak().name(), true, rsp);
         else if (req.has_destroy())
-            error = DestroyContainer(req.destroy(), rsp);
+            error = DestroyContainer(req.destroy(), client);
         else if (req.has_list())
             error = ListContainers(rsp);
         else if (req.has_getproperty())
@@ -956,9 +1355,11 @@ void HandleRpcRequest(const rpc::TContainerRequest &req,
         else if (req.has_start())
             error = StartContainer(req.start(), rsp);
         else if (req.has_stop())
-            error = StopContainer(req.stop(), rsp);
+            error = StopContainer(req.stop(), client);
+        else if (req.has_bulk())
+            error = BulkContainers(req.bulk(), rsp, client);
         else if (req.has_pause())
-            error = PauseContainer(req.pause(), rsp);
+            error = PauseContainer(req.pause(), client);
         else if (req.has_resume())
             error = ResumeContainer(req.resume(), rsp);
         else if (req.has_propertylist())
@@ -984,13 +1385,15 @@ void HandleRpcRequest(const rpc::TContainerRequest &req,
         else if (req.has_tunevolume())
             error = TuneVolume(req.tunevolume(), rsp);
         else if (req.has_importlayer())
-            error = ImportLayer(req.importlayer());
+            error = ImportLayer(req.importlayer(), client);
         else if (req.has_exportlayer())
-            error = ExportLayer(req.exportlayer());
+            error = ExportLayer(req.exportlayer(), client);
         else if (req.has_removelayer())
             error = RemoveLayer(req.removelayer());
         else if (req.has_listlayers())
             error = ListLayers(req.listlayers(), rsp);
+        else if (req.has_collectlayers())
+            error = CollectLayers(req.collectlayers(), client);
         else if (req.has_convertpath())
             error = ConvertPath(req.convertpath(), rsp);
         else
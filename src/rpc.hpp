@@ -1,7 +1,15 @@
 #pragma once
 
+#include <functional>
+
 #include "common.hpp"
 #include "client.hpp"
 
 void HandleRpcRequest(const rpc::TContainerRequest &req,
 		      std::shared_ptr<TClient> client);
+
+/* Run continuation of queued request in rpc worker */
+void QueueRpcTask(const std::function<void()> &task);
+
+/* Run task in shared pool of daemon.bulk_threads workers */
+void QueueBulkTask(const std::function<void()> &task);
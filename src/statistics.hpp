@@ -2,6 +2,13 @@
 
 #include <atomic>
 
+/* Upper bounds of start latency histogram buckets [ms], last is +inf */
+constexpr uint64_t StartLatencyBuckets[] = { 1, 2, 5, 10, 20, 50, 100, 200,
+                                             500, 1000, 2000, 5000, 10000 };
+constexpr int START_LATENCY_BUCKETS = sizeof(StartLatencyBuckets) /
+                                      sizeof(StartLatencyBuckets[0]) + 1;
+constexpr int START_STAGES_MAX = 16;
+
 struct TStatistics {
     std::atomic<uint64_t> Spawned;
     std::atomic<uint64_t> Errors;
@@ -22,6 +29,25 @@ struct TStatistics {
     std::atomic<uint64_t> ClientsCount;
     std::atomic<uint64_t> RequestsQueued;
     std::atomic<uint64_t> RequestsCompleted;
+    std::atomic<uint64_t> NetnsConnects;
+    std::atomic<uint64_t> LayerTasksQueued;
+    std::atomic<uint64_t> LayersImported;
+    std::atomic<uint64_t> LayersExported;
+    std::atomic<uint64_t> LayerDedupFiles;
+    std::atomic<uint64_t> LayerDedupBytes;
+    std::atomic<uint64_t> JunkQueued;
+    std::atomic<uint64_t> JunkReclaimed;
+    std::atomic<uint64_t> JunkFilesRemoved;
+    std::atomic<uint64_t> QuotaInodesAssigned;
+    std::atomic<uint64_t> GuaranteeSamples;
+    std::atomic<uint64_t> LayerGcRuns;
+    std::atomic<uint64_t> LayersCollected;
+    std::atomic<uint64_t> LayersCollectedBytes;
+    std::atomic<uint64_t> TasksSpawned;
+    std::atomic<uint64_t> CgroupsPooled;
+    std::atomic<uint64_t> CgroupsRecycled;
+    std::atomic<uint64_t> StartLatency[START_LATENCY_BUCKETS];
+    std::atomic<uint64_t> StartStageUs[START_STAGES_MAX];
 };
 
 extern TStatistics *Statistics;
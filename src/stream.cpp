@@ -35,18 +35,24 @@ TPath TStdStream::ResolveOutside(const TContainer &container) const {
     return container.RootPath / container.GetCwd() / Path;
 }
 
-TError TStdStream::Open(const TPath &path, const TCred &cred) {
+/*
+ * With nonblock fifo without reader fails with ENXIO instead of blocking,
+ * then descriptor is switched back into blocking mode.
+ */
+TError TStdStream::OpenFile(const TPath &path, const TCred &cred,
+                            TFile &file, bool nonblock) const {
     int fd, flags;
 
-    Offset = 0;
-
     if (Stream)
         flags = O_WRONLY | O_APPEND;
     else
         flags = O_RDONLY;
 
     /* Never assign controlling terminal at open */
-    flags |= O_NOCTTY;
+    flags |= O_NOCTTY | O_CLOEXEC;
+
+    if (nonblock)
+        flags |= O_NONBLOCK;
 
 retry:
     fd = open(path.c_str(), flags);
@@ -60,22 +66,55 @@ retry:
     if (fd < 0)
         return TError(EError::InvalidValue, errno, "open " + path.ToString());
 
-    if (fd != Stream) {
-        if (dup2(fd, Stream) < 0) {
-            close(fd);
-            return TError(EError::Unknown, errno, "dup2(" + std::to_string(fd) +
-                          ", " + std::to_string(Stream) + ")");
-        }
-        close(fd);
-    }
+    file.Close();
+    file.SetFd = fd;
+
+    if (nonblock && fcntl(fd, F_SETFL, flags & ~(O_NONBLOCK | O_CLOEXEC)) < 0)
+        return TError(EError::Unknown, errno, "fcntl " + path.ToString());
+
+    return TError::Success();
+}
+
+TError TStdStream::Open(const TPath &path, const TCred &cred) {
+    TFile file;
+
+    Offset = 0;
+
+    TError error = OpenFile(path, cred, file);
+    if (!error)
+        error = ApplyOutside(file);
+
+    /* Already in place */
+    if (file.Fd == Stream)
+        file.SetFd = -1;
+
+    return error;
+}
+
+/* Replace standard stream with file opened outside */
+TError TStdStream::ApplyOutside(const TFile &file) const {
+    if (file.Fd < 0)
+        return TError::Success();
+
+    if (file.Fd == Stream) {
+        if (fcntl(Stream, F_SETFD, 0) < 0)
+            return TError(EError::Unknown, errno, "fcntl(" + std::to_string(Stream) + ")");
+    } else if (dup2(file.Fd, Stream) < 0)
+        return TError(EError::Unknown, errno, "dup2(" + std::to_string(file.Fd) +
+                      ", " + std::to_string(Stream) + ")");
 
     return TError::Success();
 }
 
+/*
+ * Opened by portod before spawning task, so this could be done
+ * in any process. File stays closed if stream is opened inside.
+ * Portod holds container lock here thus opens never block on fifo.
+ */
 TError TStdStream::OpenOutside(const TContainer &container,
-                               const TClient &client) {
+                               const TClient &client, TFile &file) const {
     if (IsNull())
-        return Open("/dev/null", container.OwnerCred);
+        return OpenFile("/dev/null", container.OwnerCred, file, true);
 
     if (IsRedirect()) {
         int clientFd = -1;
@@ -90,27 +129,29 @@ TError TStdStream::OpenOutside(const TContainer &container,
             return error;
 
         TPath path(StringFormat("/proc/%u/fd/%u", client.Pid, clientFd));
-        error = Open(path, container.OwnerCred);
+        error = OpenFile(path, container.OwnerCred, file, true);
         if (error)
             return error;
 
         /* check permissions agains our copy */
-        path = StringFormat("/proc/self/fd/%u", Stream);
+        path = file.ProcPath();
         if (!path.HasAccess(client.TaskCred, Stream ? TPath::W : TPath::R) &&
-                !path.HasAccess(client.Cred, Stream ? TPath::W : TPath::R))
+                !path.HasAccess(client.Cred, Stream ? TPath::W : TPath::R)) {
+            file.Close();
             return TError(EError::Permission,
                     "Not enough permissions for redirect: " + Path.ToString());
+        }
     } else if (Outside)
-        return Open(ResolveOutside(container), container.OwnerCred);
+        return OpenFile(ResolveOutside(container), container.OwnerCred, file, true);
 
     return TError::Success();
 }
 
-TError TStdStream::OpenInside(const TContainer &container) {
+TError TStdStream::OpenInside(const TCred &owner) {
     TError error;
 
     if (!Outside && !IsNull() && !IsRedirect())
-        error = Open(Path, container.OwnerCred);
+        error = Open(Path, owner);
 
     /* Assign controlling terminal for our own session */
     if (!error && isatty(Stream))
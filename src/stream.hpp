@@ -30,9 +30,13 @@ public:
     bool IsRedirect(void) const;
     TPath ResolveOutside(const TContainer &container) const;
 
+    TError OpenFile(const TPath &path, const TCred &cred, TFile &file,
+                    bool nonblock = false) const;
     TError Open(const TPath &path, const TCred &cred);
-    TError OpenOutside(const TContainer &container, const TClient &client);
-    TError OpenInside(const TContainer &container);
+    TError OpenOutside(const TContainer &container, const TClient &client,
+                       TFile &file) const;
+    TError ApplyOutside(const TFile &file) const;
+    TError OpenInside(const TCred &owner);
 
     TError Remove(const TContainer &container);
 
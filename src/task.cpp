@@ -1,4 +1,5 @@
 #include <climits>
+#include <mutex>
 #include <sstream>
 #include <iterator>
 #include <csignal>
@@ -6,6 +7,8 @@
 #include "task.hpp"
 #include "device.hpp"
 #include "config.hpp"
+#include "statistics.hpp"
+#include "kv.pb.h"
 #include "util/log.hpp"
 #include "util/string.hpp"
 #include "util/signal.hpp"
@@ -23,6 +26,8 @@ extern "C" {
 #include <wordexp.h>
 #include <grp.h>
 #include <net/if.h>
+#include <poll.h>
+#include <sys/signalfd.h>
 }
 
 void TTaskEnv::ReportPid(pid_t pid) {
@@ -34,13 +39,24 @@ void TTaskEnv::ReportPid(pid_t pid) {
     ReportStage++;
 }
 
+void TTaskEnv::ReportTimings() {
+    std::string text;
+
+    (void)UintMapToString(ChildTimings, text);
+    TError error = Sock.SendString(text);
+    if (error)
+        L_ERR() << error << std::endl;
+    ReportStage++;
+}
+
 void TTaskEnv::Abort(const TError &error) {
     TError error2;
 
     /*
      * stage0: RecvPid WPid
      * stage1: RecvPid VPid
-     * stage2: RecvError
+     * stage2: RecvString timings
+     * stage3: RecvError
      */
     L() << "abort due to " << error << std::endl;
 
@@ -50,6 +66,9 @@ void TTaskEnv::Abort(const TError &error) {
             L_ERR() << error2 << std::endl;
     }
 
+    if (ReportStage < 3)
+        ReportTimings();
+
     error2 = Sock.SendError(error);
     if (error2)
         L_ERR() << error2 << std::endl;
@@ -71,11 +90,11 @@ TError TTaskEnv::ChildExec() {
 
     auto envp = Env.Envp();
 
-    if (CT->IsMeta()) {
+    if (IsMeta) {
         const char *args[] = {
             "portoinit",
             "--container",
-            CT->Name.c_str(),
+            Name.c_str(),
             NULL,
         };
         SetDieOnParentExit(0);
@@ -87,7 +106,7 @@ TError TTaskEnv::ChildExec() {
 
     wordexp_t result;
 
-    int ret = wordexp(CT->Command.c_str(), &result, WRDE_NOCMD | WRDE_UNDEF);
+    int ret = wordexp(Command.c_str(), &result, WRDE_NOCMD | WRDE_UNDEF);
     switch (ret) {
     case WRDE_BADCHAR:
         return TError(EError::Unknown, EINVAL, "wordexp(): illegal occurrence of newline or one of |, &, ;, <, >, (, ), {, }");
@@ -105,7 +124,7 @@ TError TTaskEnv::ChildExec() {
     }
 
     if (Verbose) {
-        L() << "command=" << CT->Command << std::endl;
+        L() << "command=" << Command << std::endl;
         for (unsigned i = 0; result.we_wordv[i]; i++)
             L() << "argv[" << i << "]=" << result.we_wordv[i] << std::endl;
         for (unsigned i = 0; envp[i]; i++)
@@ -120,7 +139,7 @@ TError TTaskEnv::ChildExec() {
 }
 
 TError TTaskEnv::ChildApplyLimits() {
-    for (const auto &pair :CT->Rlimit) {
+    for (const auto &pair: Rlimit) {
         int ret = setrlimit(pair.first, &pair.second);
         if (ret < 0)
             return TError(EError::Unknown, errno,
@@ -135,10 +154,10 @@ TError TTaskEnv::ChildApplyLimits() {
 TError TTaskEnv::WriteResolvConf() {
     std::string cfg;
 
-    if (!CT->ResolvConf.size())
+    if (!ResolvConf.size())
         return TError::Success();
 
-    for (auto &line: CT->ResolvConf)
+    for (auto &line: ResolvConf)
         cfg += line + "\n";
 
     return TPath("/etc/resolv.conf").WritePrivate(cfg);
@@ -147,10 +166,10 @@ TError TTaskEnv::WriteResolvConf() {
 TError TTaskEnv::SetHostname() {
     TError error;
 
-    if (CT->Hostname.size()) {
-        error = TPath("/etc/hostname").WritePrivate(CT->Hostname + "\n");
+    if (Hostname.size()) {
+        error = TPath("/etc/hostname").WritePrivate(Hostname + "\n");
         if (!error)
-            error = SetHostName(CT->Hostname);
+            error = SetHostName(Hostname);
     }
 
     return error;
@@ -179,7 +198,7 @@ TError TTaskEnv::ConfigureChild() {
             return error;
     }
 
-    if (CT->Isolate) {
+    if (Isolate) {
         // remount proc so PID namespace works
         TPath tmpProc("/proc");
         error = tmpProc.UmountAll();
@@ -212,7 +231,7 @@ TError TTaskEnv::ConfigureChild() {
             return error;
     }
 
-    if (NewMountNs && CT->BindDns && !CT->ResolvConf.size() &&
+    if (NewMountNs && BindDns && !ResolvConf.size() &&
             !Mnt.Root.IsRoot()) {
         error = Mnt.BindResolvConf();
         if (error)
@@ -260,7 +279,7 @@ TError TTaskEnv::ConfigureChild() {
             const char * argv[] = {
                 "portoinit",
                 "--container",
-                CT->Name.c_str(),
+                Name.c_str(),
                 "--wait",
                 pid_.c_str(),
                 NULL,
@@ -299,33 +318,33 @@ TError TTaskEnv::ConfigureChild() {
     if (error)
         return error;
 
-    error = CT->CapAmbient.ApplyAmbient();
+    error = CapAmbient.ApplyAmbient();
     if (error)
         return error;
 
-    error = CT->CapLimit.ApplyLimit();
+    error = CapLimit.ApplyLimit();
     if (error)
         return error;
 
     if (!Cred.IsRootUser()) {
-        error = CT->CapAmbient.ApplyEffective();
+        error = CapAmbient.ApplyEffective();
         if (error)
             return error;
     }
 
-    error = CT->Stdin.OpenInside(*CT);
+    error = Stdin.OpenInside(Mnt.OwnerCred);
     if (error)
         return error;
 
-    error = CT->Stdout.OpenInside(*CT);
+    error = Stdout.OpenInside(Mnt.OwnerCred);
     if (error)
         return error;
 
-    error = CT->Stderr.OpenInside(*CT);
+    error = Stderr.OpenInside(Mnt.OwnerCred);
     if (error)
         return error;
 
-    umask(CT->Umask);
+    umask(Umask);
 
     return TError::Success();
 }
@@ -368,16 +387,20 @@ void TTaskEnv::StartChild() {
         Abort(error);
 
     /* Report VPid in pid namespace we're enter */
-    if (!CT->Isolate)
+    if (!Isolate)
         ReportPid(getpid());
     else if (!QuadroFork)
         ReportStage++;
 
+    uint64_t mark = GetCurrentTimeUs();
+
     /* Apply configuration */
     error = ConfigureChild();
     if (error)
         Abort(error);
 
+    ChildTimings["child_setup"] = GetCurrentTimeUs() - mark;
+
     /* Wait for Wakeup */
     error = Sock.RecvZero();
     if (error)
@@ -386,180 +409,222 @@ void TTaskEnv::StartChild() {
     /* Reset signals before exec, signal block already lifted */
     ResetIgnoredSignals();
 
+    mark = GetCurrentTimeUs();
+
     error = WaitAutoconf();
     if (error)
         Abort(error);
 
+    if (!Autoconf.empty())
+        ChildTimings["child_autoconf"] = GetCurrentTimeUs() - mark;
+
+    ReportTimings();
+
     error = ChildExec();
     Abort(error);
 }
 
-TError TTaskEnv::Start() {
+/* Middle task: enters cgroups and namespaces and clones the task */
+void TTaskEnv::StartParent() {
     TError error;
 
-    CT->Task.Pid = 0;
-    CT->TaskVPid = 0;
-    CT->WaitTask.Pid = 0;
+    /* Switch from signafd back to normal signal delivery */
+    ResetBlockedSignals();
 
-    error = TUnixSocket::SocketPair(MasterSock, Sock);
-    if (error)
-        return error;
+    SetDieOnParentExit(SIGKILL);
 
-    // we want our child to have portod master as parent, so we
-    // are doing double fork here (fork + clone);
-    // we also need to know child pid so we are using pipe to send it back
+    SetProcessName("portod-spawn-p");
 
-    pid_t forkPid = ForkFromThread();
-    if (forkPid < 0) {
-        Sock.Close();
-        TError error(EError::Unknown, errno, "fork()");
-        L() << "Can't spawn child: " << error << std::endl;
-        return error;
-    } else if (forkPid == 0) {
-        TError error;
+    char stack[8192];
 
-        /* Switch from signafd back to normal signal delivery */
-        ResetBlockedSignals();
+    (void)setsid();
 
-        SetDieOnParentExit(SIGKILL);
+    // move to target cgroups
+    for (auto &cg : Cgroups) {
+        error = cg.Attach(getpid());
+        if (error)
+            Abort(error);
+    }
 
-        SetProcessName("portod-spawn-p");
+    /* Default streams and redirections are opened outside by portod */
+    error = Stdin.ApplyOutside(StdinFile);
+    if (error)
+        Abort(error);
 
-        char stack[8192];
+    error = Stdout.ApplyOutside(StdoutFile);
+    if (error)
+        Abort(error);
 
-        (void)setsid();
+    error = Stderr.ApplyOutside(StderrFile);
+    if (error)
+        Abort(error);
 
-        // move to target cgroups
-        for (auto &cg : Cgroups) {
-            error = cg.Attach(getpid());
-            if (error)
-                Abort(error);
-        }
+    /* Enter parent namespaces */
+    error = ParentNs.Enter();
+    if (error)
+        Abort(error);
 
-        /* Default streams and redirections are outside */
-        error = CT->Stdin.OpenOutside(*CT, *Client);
-        if (error)
-            Abort(error);
+    if (TripleFork) {
+        /*
+         * Enter into pid-namespace. fork() hangs in libc if child pid
+         * collide with parent pid outside. vfork() has no such problem.
+         */
+        pid_t forkPid = vfork();
+        if (forkPid < 0)
+            Abort(TError(EError::Unknown, errno, "fork()"));
 
-        error = CT->Stdout.OpenOutside(*CT, *Client);
-        if (error)
-            Abort(error);
+        if (forkPid)
+            _exit(EXIT_SUCCESS);
+    }
 
-        error = CT->Stderr.OpenOutside(*CT, *Client);
+    if (QuadroFork) {
+        error = TUnixSocket::SocketPair(MasterSock2, Sock2);
         if (error)
             Abort(error);
+    }
 
-        /* Enter parent namespaces */
-        error = ParentNs.Enter();
-        if (error)
-            Abort(error);
+    int cloneFlags = SIGCHLD;
+    if (Isolate)
+        cloneFlags |= CLONE_NEWPID | CLONE_NEWIPC;
 
-        if (TripleFork) {
-            /*
-             * Enter into pid-namespace. fork() hangs in libc if child pid
-             * collide with parent pid outside. vfork() has no such problem.
-             */
-            forkPid = vfork();
-            if (forkPid < 0)
-                Abort(TError(EError::Unknown, errno, "fork()"));
-
-            if (forkPid)
-                _exit(EXIT_SUCCESS);
-        }
+    if (NewMountNs)
+        cloneFlags |= CLONE_NEWNS;
 
-        if (QuadroFork) {
-            error = TUnixSocket::SocketPair(MasterSock2, Sock2);
-            if (error)
-                Abort(error);
-        }
+    /* Create UTS namspace if hostname is changed or isolate=true */
+    if (Isolate || Hostname != "")
+        cloneFlags |= CLONE_NEWUTS;
 
-        int cloneFlags = SIGCHLD;
-        if (CT->Isolate)
-            cloneFlags |= CLONE_NEWPID | CLONE_NEWIPC;
+    pid_t clonePid = clone(ChildFn, stack + sizeof(stack), cloneFlags, this);
 
-        if (NewMountNs)
-            cloneFlags |= CLONE_NEWNS;
+    if (clonePid < 0) {
+        TError error(errno == ENOMEM ?
+                     EError::ResourceNotAvailable :
+                     EError::Unknown, errno, "clone()");
+        Abort(error);
+    }
 
-        /* Create UTS namspace if hostname is changed or isolate=true */
-        if (CT->Isolate || CT->Hostname != "")
-            cloneFlags |= CLONE_NEWUTS;
+    /* Report WPid in host pid namespace */
+    if (TripleFork)
+        ReportPid(GetTid());
+    else
+        ReportPid(clonePid);
 
-        pid_t clonePid = clone(ChildFn, stack + sizeof(stack), cloneFlags, this);
+    /* Report VPid in parent pid namespace for new pid-ns */
+    if (Isolate && !QuadroFork)
+        ReportPid(clonePid);
 
-        if (clonePid < 0) {
-            TError error(errno == ENOMEM ?
-                         EError::ResourceNotAvailable :
-                         EError::Unknown, errno, "clone()");
-            Abort(error);
-        }
+    /* WPid reported, wakeup child */
+    error = MasterSock.SendZero();
+    if (error)
+        Abort(error);
 
-        /* Report WPid in host pid namespace */
-        if (TripleFork)
-            ReportPid(GetTid());
-        else
-            ReportPid(clonePid);
+    /* ChildCallback() reports VPid here if !Isolate */
+    if (!Isolate && !QuadroFork)
+        ReportStage++;
 
-        /* Report VPid in parent pid namespace for new pid-ns */
-        if (CT->Isolate && !QuadroFork)
-            ReportPid(clonePid);
+    /*
+     * QuadroFork waiter receives application VPid from init
+     * task and forwards it into host.
+     */
+    if (QuadroFork) {
+        pid_t appPid, appVPid;
+
+        /* close other side before reading */
+        Sock2.Close();
 
-        /* WPid reported, wakeup child */
-        error = MasterSock.SendZero();
+        error = MasterSock2.RecvPid(appPid, appVPid);
+        if (error)
+            Abort(error);
+        /* Forward VPid */
+        ReportPid(appPid);
+        error = MasterSock2.SendZero();
         if (error)
             Abort(error);
 
-        /* ChildCallback() reports VPid here if !Isolate */
-        if (!CT->Isolate && !QuadroFork)
-            ReportStage++;
+        MasterSock2.Close();
+    }
 
-        /*
-         * QuadroFork waiter receives application VPid from init
-         * task and forwards it into host.
-         */
-        if (QuadroFork) {
-            pid_t appPid, appVPid;
+    if (TripleFork) {
+        auto pid = std::to_string(clonePid);
+        const char * argv[] = {
+            "portoinit",
+            "--container",
+            Name.c_str(),
+            "--wait",
+            pid.c_str(),
+            NULL,
+        };
+        auto envp = Env.Envp();
 
-            /* close other side before reading */
-            Sock2.Close();
+        error = PortoInitCapabilities.ApplyLimit();
+        if (error)
+            _exit(EXIT_FAILURE);
 
-            error = MasterSock2.RecvPid(appPid, appVPid);
-            if (error)
-                Abort(error);
-            /* Forward VPid */
-            ReportPid(appPid);
-            error = MasterSock2.SendZero();
-            if (error)
-                Abort(error);
+        TFile::CloseAll({PortoInit.Fd});
+        fexecve(PortoInit.Fd, (char *const *)argv, envp);
+        kill(clonePid, SIGKILL);
+        _exit(EXIT_FAILURE);
+    }
 
-            MasterSock2.Close();
-        }
+    _exit(EXIT_SUCCESS);
+}
 
-        if (TripleFork) {
-            auto pid = std::to_string(clonePid);
-            const char * argv[] = {
-                "portoinit",
-                "--container",
-                CT->Name.c_str(),
-                "--wait",
-                pid.c_str(),
-                NULL,
-            };
-            auto envp = Env.Envp();
+TError TTaskEnv::Start() {
+    uint64_t mark = GetCurrentTimeUs();
+    bool spawned = false;
+    pid_t forkPid = 0;
+    TError error;
 
-            error = PortoInitCapabilities.ApplyLimit();
-            if (error)
-                _exit(EXIT_FAILURE);
+    CT->Task.Pid = 0;
+    CT->TaskVPid = 0;
+    CT->WaitTask.Pid = 0;
 
-            TFile::CloseAll({PortoInit.Fd});
-            fexecve(PortoInit.Fd, (char *const *)argv, envp);
-            kill(clonePid, SIGKILL);
-            _exit(EXIT_FAILURE);
-        }
+    error = TUnixSocket::SocketPair(MasterSock, Sock);
+    if (error)
+        return error;
 
-        _exit(EXIT_SUCCESS);
+    error = Stdin.OpenOutside(*CT, *Client, StdinFile);
+    if (error)
+        return error;
+
+    error = Stdout.OpenOutside(*CT, *Client, StdoutFile);
+    if (error)
+        return error;
+
+    error = Stderr.OpenOutside(*CT, *Client, StderrFile);
+    if (error)
+        return error;
+
+    if (config().daemon().spawner()) {
+        error = Spawn(forkPid);
+        if (error.GetError() == EError::Queued) {
+            L_WRN() << "Spawner is not available, fallback to fork" << std::endl;
+        } else if (error) {
+            L() << "Can't spawn child: " << error << std::endl;
+            return error;
+        } else
+            spawned = true;
+    }
+
+    // we want our child to have portod master as parent, so we
+    // are doing double fork here (fork + clone);
+    // we also need to know child pid so we are using pipe to send it back
+
+    if (!spawned) {
+        forkPid = ForkFromThread();
+        if (forkPid < 0) {
+            Sock.Close();
+            TError error(EError::Unknown, errno, "fork()");
+            L() << "Can't spawn child: " << error << std::endl;
+            return error;
+        } else if (forkPid == 0)
+            StartParent();
     }
 
     Sock.Close();
+    StdinFile.Close();
+    StdoutFile.Close();
+    StderrFile.Close();
 
     error = MasterSock.SetRecvTimeout(config().container().start_timeout_ms());
     if (error)
@@ -569,27 +634,52 @@ TError TTaskEnv::Start() {
     if (error)
         goto kill_all;
 
+    CT->StartStage("fork", mark);
+
     error = MasterSock.RecvPid(CT->Task.Pid, CT->TaskVPid);
     if (error)
         goto kill_all;
 
+    CT->StartStage("clone", mark);
+
     int status;
-    if (waitpid(forkPid, &status, 0) < 0) {
+    if (spawned) {
+        /* Middle task is reaped by spawner */
+        error = MasterStatusSock.RecvInt(status);
+        if (error)
+            goto kill_all;
+    } else if (waitpid(forkPid, &status, 0) < 0) {
         error = TError(EError::Unknown, errno, "wait for middle task failed");
         goto kill_all;
     }
     forkPid = 0;
 
+    CT->StartStage("middle", mark);
+
     /* Task was alive, even if it already died we'll get zombie */
     error = MasterSock.SendZero();
     if (error)
         L() << "Task wakeup error: " << error << std::endl;
 
+    /* Task reports own timings right before exec or error, child_setup
+       overlaps with clone and middle, child_autoconf is a part of exec */
+    {
+        std::string text;
+        TUintMap timings;
+
+        if (!MasterSock.RecvString(text, 4096) && !StringToUintMap(text, timings)) {
+            for (auto &it: timings)
+                CT->StartTimings[it.first] = it.second;
+        }
+    }
+
     /* Prefer reported error if any */
     error = MasterSock.RecvError();
     if (error)
         goto kill_all;
 
+    CT->StartStage("exec", mark);
+
     if (!error && status) {
         error = TError(EError::Unknown, "Start failed, status " + std::to_string(status));
         goto kill_all;
@@ -603,10 +693,522 @@ kill_all:
         (void)cg.KillAll(SIGKILL);
     if (forkPid) {
         (void)kill(forkPid, SIGKILL);
-        (void)waitpid(forkPid, nullptr, 0);
+        if (!spawned)
+            (void)waitpid(forkPid, nullptr, 0);
     }
     CT->Task.Pid = 0;
     CT->TaskVPid = 0;
     CT->WaitTask.Pid = 0;
     return error;
 }
+
+/*
+ * Spawner: small single-threaded helper forked at daemon start before any
+ * threads. It receives serialized task environment and descriptors and
+ * forks the middle task on behalf of portod, thus multi-threaded portod
+ * with huge address space never forks in start hot path.
+ */
+
+static std::mutex SpawnerMutex;
+static TUnixSocket SpawnerSock;
+static pid_t SpawnerPid = 0;
+
+static constexpr size_t SpawnerMaxRequest = 16 << 20;
+
+static void NodeAdd(kv::TNode &node, const std::string &key, const std::string &val) {
+    auto pair = node.add_pairs();
+    pair->set_key(key);
+    pair->set_val(val);
+}
+
+static std::string FormatCred(const TCred &cred) {
+    std::string str = std::to_string(cred.Uid) + " " + std::to_string(cred.Gid);
+    for (auto gid: cred.Groups)
+        str += " " + std::to_string(gid);
+    return str;
+}
+
+static TError ParseCred(const std::string &str, TCred &cred) {
+    std::vector<std::string> ids;
+    int id;
+
+    TError error = SplitString(str, ' ', ids);
+    if (error || ids.size() < 2)
+        return TError(EError::InvalidValue, "Invalid cred: " + str);
+
+    cred.Groups.clear();
+    for (unsigned i = 0; i < ids.size(); i++) {
+        error = StringToInt(ids[i], id);
+        if (error)
+            return error;
+        if (i == 0)
+            cred.Uid = id;
+        else if (i == 1)
+            cred.Gid = id;
+        else
+            cred.Groups.push_back(id);
+    }
+
+    return TError::Success();
+}
+
+void TTaskEnv::Serialize(kv::TNode &node, std::vector<int> &fds) const {
+    auto addFd = [&](const std::string &name, int fd) {
+        if (fd >= 0) {
+            NodeAdd(node, "fd", name);
+            fds.push_back(fd);
+        }
+    };
+
+    NodeAdd(node, "name", Name);
+    NodeAdd(node, "command", Command);
+    NodeAdd(node, "meta", IsMeta ? "1" : "0");
+    NodeAdd(node, "isolate", Isolate ? "1" : "0");
+    NodeAdd(node, "bind_dns", BindDns ? "1" : "0");
+    NodeAdd(node, "hostname", Hostname);
+    for (auto &line: ResolvConf)
+        NodeAdd(node, "resolv_conf", line);
+    NodeAdd(node, "triple_fork", TripleFork ? "1" : "0");
+    NodeAdd(node, "quadro_fork", QuadroFork ? "1" : "0");
+    NodeAdd(node, "new_mount_ns", NewMountNs ? "1" : "0");
+    NodeAdd(node, "cred", FormatCred(Cred));
+    NodeAdd(node, "cap_ambient", std::to_string(CapAmbient.Permitted));
+    NodeAdd(node, "cap_limit", std::to_string(CapLimit.Permitted));
+    NodeAdd(node, "umask", std::to_string(Umask));
+
+    for (auto &it: Rlimit)
+        NodeAdd(node, "rlimit", std::to_string(it.first) + " " +
+                std::to_string(it.second.rlim_cur) + " " +
+                std::to_string(it.second.rlim_max));
+
+    std::vector<std::string> env;
+    Env.Format(env);
+    for (auto &line: env)
+        NodeAdd(node, "env", line);
+
+    for (auto &name: Autoconf)
+        NodeAdd(node, "autoconf", name);
+
+    for (auto &dev: Devices)
+        NodeAdd(node, "device", StringFormat("%o %lu %u %u %d ",
+                    dev.Mode, (unsigned long)dev.Device,
+                    dev.User, dev.Group, dev.Wildcard) + dev.Name);
+
+    for (auto &cg: Cgroups)
+        NodeAdd(node, "cgroup", cg.Type() + ":" + cg.Name);
+
+    NodeAdd(node, "mnt_container", Mnt.Container);
+    NodeAdd(node, "mnt_owner", FormatCred(Mnt.OwnerCred));
+    NodeAdd(node, "mnt_cwd", Mnt.Cwd.ToString());
+    NodeAdd(node, "mnt_parent_cwd", Mnt.ParentCwd.ToString());
+    NodeAdd(node, "mnt_root", Mnt.Root.ToString());
+    NodeAdd(node, "mnt_root_ro", Mnt.RootRdOnly ? "1" : "0");
+    NodeAdd(node, "mnt_bind_porto_sock", Mnt.BindPortoSock ? "1" : "0");
+    NodeAdd(node, "mnt_run_size", std::to_string(Mnt.RunSize));
+    NodeAdd(node, "mnt_proc_template", Mnt.ProcTemplate ? "1" : "0");
+    for (auto &bind: Mnt.BindMounts) {
+        NodeAdd(node, "bind_source", bind.Source.ToString());
+        NodeAdd(node, "bind_dest", bind.Dest.ToString());
+        NodeAdd(node, "bind_flags", std::to_string(bind.ReadOnly) +
+                                    std::to_string(bind.ReadWrite));
+    }
+
+    for (auto std: { &Stdin, &Stdout, &Stderr }) {
+        auto prefix = "std" + std::to_string(std->Stream);
+        NodeAdd(node, prefix + "_path", std->Path.ToString());
+        NodeAdd(node, prefix + "_outside", std->Outside ? "1" : "0");
+    }
+
+    addFd("sock", Sock.GetFd());
+    addFd("status", StatusSock.GetFd());
+    addFd("portoinit", PortoInit.Fd);
+    addFd("ns_ipc", ParentNs.Ipc.GetFd());
+    addFd("ns_uts", ParentNs.Uts.GetFd());
+    addFd("ns_net", ParentNs.Net.GetFd());
+    addFd("ns_pid", ParentNs.Pid.GetFd());
+    addFd("ns_mnt", ParentNs.Mnt.GetFd());
+    addFd("ns_root", ParentNs.Root.GetFd());
+    addFd("ns_cwd", ParentNs.Cwd.GetFd());
+    addFd("std0", StdinFile.Fd);
+    addFd("std1", StdoutFile.Fd);
+    addFd("std2", StderrFile.Fd);
+}
+
+TError TTaskEnv::Deserialize(const kv::TNode &node, std::vector<int> &fds) {
+    std::vector<std::string> env, bindSource, bindDest, bindFlags;
+    unsigned fdIndex = 0;
+    uint64_t val;
+    TError error;
+
+    for (int i = 0; i < node.pairs_size(); i++) {
+        auto &key = node.pairs(i).key();
+        auto &value = node.pairs(i).val();
+
+        if (key == "name")
+            Name = value;
+        else if (key == "command")
+            Command = value;
+        else if (key == "meta")
+            IsMeta = value == "1";
+        else if (key == "isolate")
+            Isolate = value == "1";
+        else if (key == "bind_dns")
+            BindDns = value == "1";
+        else if (key == "hostname")
+            Hostname = value;
+        else if (key == "resolv_conf")
+            ResolvConf.push_back(value);
+        else if (key == "triple_fork")
+            TripleFork = value == "1";
+        else if (key == "quadro_fork")
+            QuadroFork = value == "1";
+        else if (key == "new_mount_ns")
+            NewMountNs = value == "1";
+        else if (key == "cred")
+            error = ParseCred(value, Cred);
+        else if (key == "cap_ambient")
+            error = StringToUint64(value, CapAmbient.Permitted);
+        else if (key == "cap_limit")
+            error = StringToUint64(value, CapLimit.Permitted);
+        else if (key == "umask") {
+            error = StringToUint64(value, val);
+            Umask = val;
+        } else if (key == "rlimit") {
+            unsigned long long cur, max;
+            int res;
+            if (sscanf(value.c_str(), "%d %llu %llu", &res, &cur, &max) != 3)
+                return TError(EError::InvalidValue, "Invalid rlimit: " + value);
+            Rlimit[res].rlim_cur = cur;
+            Rlimit[res].rlim_max = max;
+        } else if (key == "env")
+            env.push_back(value);
+        else if (key == "autoconf")
+            Autoconf.push_back(value);
+        else if (key == "device") {
+            TDevice dev;
+            unsigned long rdev;
+            unsigned mode;
+            int wildcard, pos = 0;
+            if (sscanf(value.c_str(), "%o %lu %u %u %d %n", &mode, &rdev,
+                       &dev.User, &dev.Group, &wildcard, &pos) != 5 || !pos)
+                return TError(EError::InvalidValue, "Invalid device: " + value);
+            dev.Mode = mode;
+            dev.Device = rdev;
+            dev.Wildcard = wildcard;
+            dev.Name = value.substr(pos);
+            dev.Path = dev.Name;
+            Devices.push_back(dev);
+        } else if (key == "cgroup") {
+            auto sep = value.find(':');
+            const TSubsystem *subsys = nullptr;
+            for (auto hy: Hierarchies)
+                if (hy->Type == value.substr(0, sep))
+                    subsys = hy;
+            if (!subsys || sep == std::string::npos)
+                return TError(EError::InvalidValue, "Unknown cgroup: " + value);
+            Cgroups.push_back(TCgroup(subsys, value.substr(sep + 1)));
+        } else if (key == "mnt_container")
+            Mnt.Container = value;
+        else if (key == "mnt_owner")
+            error = ParseCred(value, Mnt.OwnerCred);
+        else if (key == "mnt_cwd")
+            Mnt.Cwd = value;
+        else if (key == "mnt_parent_cwd")
+            Mnt.ParentCwd = value;
+        else if (key == "mnt_root")
+            Mnt.Root = value;
+        else if (key == "mnt_root_ro")
+            Mnt.RootRdOnly = value == "1";
+        else if (key == "mnt_bind_porto_sock")
+            Mnt.BindPortoSock = value == "1";
+        else if (key == "mnt_run_size")
+            error = StringToUint64(value, Mnt.RunSize);
+        else if (key == "mnt_proc_template")
+            Mnt.ProcTemplate = value == "1";
+        else if (key == "bind_source")
+            bindSource.push_back(value);
+        else if (key == "bind_dest")
+            bindDest.push_back(value);
+        else if (key == "bind_flags")
+            bindFlags.push_back(value);
+        else if (key == "std0_path")
+            Stdin.Path = value;
+        else if (key == "std0_outside")
+            Stdin.Outside = value == "1";
+        else if (key == "std1_path")
+            Stdout.Path = value;
+        else if (key == "std1_outside")
+            Stdout.Outside = value == "1";
+        else if (key == "std2_path")
+            Stderr.Path = value;
+        else if (key == "std2_outside")
+            Stderr.Outside = value == "1";
+        else if (key == "fd") {
+            if (fdIndex >= fds.size())
+                return TError(EError::InvalidValue, "Not enough fds");
+            int fd = fds[fdIndex];
+            fds[fdIndex++] = -1;
+
+            if (value == "sock")
+                Sock = fd;
+            else if (value == "status")
+                StatusSock = fd;
+            else if (value == "portoinit")
+                PortoInit.SetFd = fd;
+            else if (value == "ns_ipc")
+                ParentNs.Ipc.EatFd(fd);
+            else if (value == "ns_uts")
+                ParentNs.Uts.EatFd(fd);
+            else if (value == "ns_net")
+                ParentNs.Net.EatFd(fd);
+            else if (value == "ns_pid")
+                ParentNs.Pid.EatFd(fd);
+            else if (value == "ns_mnt")
+                ParentNs.Mnt.EatFd(fd);
+            else if (value == "ns_root")
+                ParentNs.Root.EatFd(fd);
+            else if (value == "ns_cwd")
+                ParentNs.Cwd.EatFd(fd);
+            else if (value == "std0")
+                StdinFile.SetFd = fd;
+            else if (value == "std1")
+                StdoutFile.SetFd = fd;
+            else if (value == "std2")
+                StderrFile.SetFd = fd;
+            else {
+                close(fd);
+                return TError(EError::InvalidValue, "Unknown fd: " + value);
+            }
+        } else
+            return TError(EError::InvalidValue, "Unknown task key: " + key);
+
+        if (error)
+            return error;
+    }
+
+    error = Env.Parse(env, true);
+    if (error)
+        return error;
+
+    if (bindSource.size() != bindDest.size() ||
+            bindSource.size() != bindFlags.size())
+        return TError(EError::InvalidValue, "Inconsistent bind mounts");
+
+    for (unsigned i = 0; i < bindSource.size(); i++) {
+        TBindMount bind;
+        bind.Source = bindSource[i];
+        bind.Dest = bindDest[i];
+        bind.ReadOnly = bindFlags[i].size() == 2 && bindFlags[i][0] == '1';
+        bind.ReadWrite = bindFlags[i].size() == 2 && bindFlags[i][1] == '1';
+        Mnt.BindMounts.push_back(bind);
+    }
+
+    return TError::Success();
+}
+
+static void SpawnerRequest(const TUnixSocket &sock,
+                           std::map<pid_t, std::shared_ptr<TTaskEnv>> &tasks) {
+    std::vector<int> fds;
+    std::string data;
+    kv::TNode node;
+    int count;
+
+    TError error = sock.RecvString(data, SpawnerMaxRequest);
+    if (!error)
+        error = sock.RecvInt(count);
+    for (int i = 0; !error && i < count; i++) {
+        int fd;
+        error = sock.RecvFd(fd);
+        if (!error)
+            fds.push_back(fd);
+    }
+    if (error) {
+        for (auto fd: fds)
+            close(fd);
+        /* Protocol is broken, portod will restart us */
+        _exit(EXIT_FAILURE);
+    }
+
+    auto env = std::make_shared<TTaskEnv>();
+
+    if (!node.ParseFromString(data))
+        error = TError(EError::Unknown, "Cannot parse spawn request");
+    else
+        error = env->Deserialize(node, fds);
+
+    for (auto fd: fds)
+        if (fd >= 0)
+            close(fd);
+
+    pid_t pid = -1;
+    if (!error) {
+        pid = fork();
+        if (pid < 0)
+            error = TError(EError::Unknown, errno, "fork()");
+        else if (pid == 0) {
+            SpawnerSock.Close();
+            env->StartParent();
+        }
+    }
+
+    /* Reply goes into status socket, main socket stays in sync */
+    if (error) {
+        (void)env->StatusSock.SendInt(-1);
+        (void)env->StatusSock.SendError(error);
+        return;
+    }
+
+    if (env->StatusSock.SendInt(pid)) {
+        kill(pid, SIGKILL);
+        return;
+    }
+
+    env->Sock.Close();
+    env->PortoInit.Close();
+    env->StdinFile.Close();
+    env->StdoutFile.Close();
+    env->StderrFile.Close();
+    tasks[pid] = env;
+}
+
+static void SpawnerMain(int sigFd) {
+    std::map<pid_t, std::shared_ptr<TTaskEnv>> tasks;
+
+    SetDieOnParentExit(SIGKILL);
+    SetProcessName("portod-spawner");
+
+    close(PORTO_SK_FD);
+    close(REAP_EVT_FD);
+    close(REAP_ACK_FD);
+
+    while (true) {
+        struct pollfd pfd[2] = {
+            { SpawnerSock.GetFd(), POLLIN, 0 },
+            { sigFd, POLLIN, 0 },
+        };
+
+        if (poll(pfd, 2, -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            _exit(EXIT_FAILURE);
+        }
+
+        if (pfd[1].revents) {
+            struct signalfd_siginfo info;
+
+            while (read(sigFd, &info, sizeof(info)) > 0) { }
+
+            pid_t pid;
+            int status;
+            while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+                auto it = tasks.find(pid);
+                if (it != tasks.end()) {
+                    (void)it->second->StatusSock.SendInt(status);
+                    tasks.erase(it);
+                }
+            }
+        }
+
+        if (pfd[0].revents & POLLIN)
+            SpawnerRequest(SpawnerSock, tasks);
+        else if (pfd[0].revents)
+            _exit(EXIT_SUCCESS);
+    }
+}
+
+TError StartSpawner() {
+    TUnixSocket sock;
+    sigset_t mask;
+
+    TError error = TUnixSocket::SocketPair(SpawnerSock, sock);
+    if (error)
+        return error;
+
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+
+    /* Still single-threaded, plain fork is fine */
+    pid_t pid = fork();
+    if (pid < 0) {
+        SpawnerSock.Close();
+        return TError(EError::Unknown, errno, "fork()");
+    }
+
+    if (pid == 0) {
+        SpawnerSock = std::move(sock);
+
+        if (sigprocmask(SIG_BLOCK, &mask, nullptr))
+            _exit(EXIT_FAILURE);
+
+        int sigFd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+        if (sigFd < 0)
+            _exit(EXIT_FAILURE);
+
+        SpawnerMain(sigFd);
+    }
+
+    SpawnerPid = pid;
+    L_SYS() << "Start spawner " << pid << std::endl;
+
+    return TError::Success();
+}
+
+TError TTaskEnv::Spawn(pid_t &pid) {
+    std::vector<int> fds;
+    std::string data;
+    kv::TNode node;
+    TError error;
+
+    std::unique_lock<std::mutex> lock(SpawnerMutex);
+
+    if (!SpawnerPid)
+        return TError::Queued();
+
+    error = TUnixSocket::SocketPair(MasterStatusSock, StatusSock);
+    if (error)
+        return error;
+
+    Serialize(node, fds);
+
+    if (!node.SerializeToString(&data))
+        return TError(EError::Unknown, "Cannot serialize spawn request");
+
+    error = SpawnerSock.SendString(data);
+    if (!error)
+        error = SpawnerSock.SendInt(fds.size());
+    for (auto fd: fds) {
+        if (error)
+            break;
+        error = SpawnerSock.SendFd(fd);
+    }
+
+    if (error) {
+        L_ERR() << "Spawner is broken: " << error << std::endl;
+        SpawnerSock.Close();
+        (void)kill(SpawnerPid, SIGKILL);
+        (void)waitpid(SpawnerPid, nullptr, 0);
+        SpawnerPid = 0;
+        StatusSock.Close();
+        MasterStatusSock.Close();
+        return TError::Queued();
+    }
+
+    lock.unlock();
+
+    StatusSock.Close();
+
+    error = MasterStatusSock.SetRecvTimeout(config().container().start_timeout_ms());
+    if (!error)
+        error = MasterStatusSock.RecvInt(pid);
+    if (!error && pid <= 0) {
+        error = MasterStatusSock.RecvError();
+        if (!error)
+            error = TError(EError::Unknown, "Spawner failed");
+    }
+    if (error)
+        return error;
+
+    Statistics->TasksSpawned++;
+
+    return TError::Success();
+}
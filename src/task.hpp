@@ -11,11 +11,16 @@
 #include "cgroup.hpp"
 #include "env.hpp"
 #include "filesystem.hpp"
+#include "stream.hpp"
 
 extern "C" {
 #include <sys/resource.h>
 }
 
+namespace kv {
+    class TNode;
+}
+
 struct TTaskEnv {
     std::shared_ptr<TContainer> CT;
     TClient *Client;
@@ -31,11 +36,29 @@ struct TTaskEnv {
     std::vector<TCgroup> Cgroups;
     TCred Cred;
 
+    /* Copy of container configuration, task could be spawned without it */
+    std::string Name;
+    std::string Command;
+    bool IsMeta;
+    bool Isolate;
+    bool BindDns;
+    std::string Hostname;
+    std::vector<std::string> ResolvConf;
+    std::map<int, struct rlimit> Rlimit;
+    TCapabilities CapAmbient;
+    TCapabilities CapLimit;
+    mode_t Umask;
+    TStdStream Stdin{0}, Stdout{1}, Stderr{2};
+    TFile StdinFile, StdoutFile, StderrFile; /* opened outside */
+
     TUnixSocket Sock, MasterSock;
     TUnixSocket Sock2, MasterSock2;
+    TUnixSocket StatusSock, MasterStatusSock; /* middle task status from spawner */
     int ReportStage = 0;
+    TUintMap ChildTimings; /* reported by task before exec */
 
     TError Start();
+    void StartParent();
     void StartChild();
 
     TError ConfigureChild();
@@ -47,5 +70,12 @@ struct TTaskEnv {
     TError ChildExec();
 
     void ReportPid(pid_t pid);
+    void ReportTimings();
     void Abort(const TError &error);
+
+    TError Spawn(pid_t &pid);
+    void Serialize(kv::TNode &node, std::vector<int> &fds) const;
+    TError Deserialize(const kv::TNode &node, std::vector<int> &fds);
 };
+
+extern TError StartSpawner();
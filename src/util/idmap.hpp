@@ -6,46 +6,105 @@
 #include "common.hpp"
 #include "log.hpp"
 
+/*
+ * Two-level bitmap: bit per id in Used, bit per completely used word in Full.
+ * FreeHint points to the first word which might have free ids, so Get() is
+ * amortized O(1) and always returns the lowest free id.
+ */
 class TIdMap : public TNonCopyable {
 private:
     int Base;
-    std::vector<bool> Used;
+    int Size = 0;
+    int FreeHint = 0;
+    std::vector<uint64_t> Used;
+    std::vector<uint64_t> Full;
+
+    static constexpr int WordBits = 64;
+
+    void UpdateFull(int word) {
+        if (Used[word] == ~0ull)
+            Full[word / WordBits] |= BIT(word % WordBits);
+        else
+            Full[word / WordBits] &= ~BIT(word % WordBits);
+    }
+
+    bool IsUsed(int idx) const {
+        return Used[idx / WordBits] & BIT(idx % WordBits);
+    }
+
+    void SetUsed(int idx, bool used) {
+        int word = idx / WordBits;
+        if (used)
+            Used[word] |= BIT(idx % WordBits);
+        else
+            Used[word] &= ~BIT(idx % WordBits);
+        UpdateFull(word);
+    }
+
 public:
     TIdMap(int base, int size) {
         Base = base;
         Resize(size);
     }
 
+    int GetSize() const {
+        return Size;
+    }
+
     void Resize(int size) {
-        Used.resize(size, false);
+        int words = (size + WordBits - 1) / WordBits;
+        int old = Size;
+
+        Used.resize(words, 0);
+        Full.resize((words + WordBits - 1) / WordBits, 0);
+        Size = size;
+
+        /* tail bits beyond size are permanently used */
+        for (int idx = std::min(old, size); idx < words * WordBits; idx++)
+            SetUsed(idx, idx >= size);
+
+        FreeHint = 0;
     }
 
     TError GetAt(int id) {
-        if (id < Base || id >= Base + (int)Used.size())
+        if (id < Base || id >= Base + Size)
             return TError(EError::Unknown, "Id " + std::to_string(id) + " out of range");
-        if (Used[id - Base])
+        if (IsUsed(id - Base))
             return TError(EError::Unknown, "Id " + std::to_string(id) + " already used");
-        Used[id - Base] = true;
+        SetUsed(id - Base, true);
         return TError::Success();
     }
 
     TError Get(int &id) {
-        auto it = std::find(Used.begin(), Used.end(), false);
-        if (it == Used.end()) {
-            id = -1;
-            return TError(EError::ResourceNotAvailable, "Cannot allocate id");
+        int words = Used.size();
+
+        for (int f = FreeHint / WordBits; f < (int)Full.size(); f++) {
+            if (Full[f] == ~0ull)
+                continue;
+
+            int word = f * WordBits + __builtin_ctzll(~Full[f]);
+            if (word >= words)
+                break;
+
+            int idx = word * WordBits + __builtin_ctzll(~Used[word]);
+            SetUsed(idx, true);
+            FreeHint = word;
+            id = Base + idx;
+            return TError::Success();
         }
-        id = Base + (it - Used.begin());
-        *it = true;
-        return TError::Success();
+
+        FreeHint = words;
+        id = -1;
+        return TError(EError::ResourceNotAvailable, "Cannot allocate id");
     }
 
     TError Put(int id) {
-        if (id < Base || id >= Base + (int)Used.size())
+        if (id < Base || id >= Base + Size)
             return TError(EError::Unknown, "Id out of range");
-        if (!Used[id - Base])
+        if (!IsUsed(id - Base))
             return TError(EError::Unknown, "Freeing not allocated id");
-        Used[id - Base] = false;
+        SetUsed(id - Base, false);
+        FreeHint = std::min(FreeHint, (id - Base) / WordBits);
         return TError::Success();
     }
 };
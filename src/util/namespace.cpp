@@ -30,6 +30,14 @@ TError TNamespaceFd::Open(pid_t pid, std::string type) {
     return Open("/proc/" + std::to_string(pid) + "/" + type);
 }
 
+TError TNamespaceFd::Dup(const TNamespaceFd &src) {
+    Close();
+    Fd = fcntl(src.Fd, F_DUPFD_CLOEXEC, 0);
+    if (Fd < 0)
+        return TError(EError::Unknown, errno, "Cannot duplicate namespace fd");
+    return TError::Success();
+}
+
 void TNamespaceFd::Close() {
     if (Fd >= 0) {
         close(Fd);
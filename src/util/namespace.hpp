@@ -19,6 +19,8 @@ public:
     TError Open(pid_t pid, std::string type);
     int GetFd() const { return Fd; }
     void EatFd(TNamespaceFd &src) { Close(); Fd = src.Fd; src.Fd = -1; }
+    void EatFd(int fd) { Close(); Fd = fd; }
+    TError Dup(const TNamespaceFd &src);
     void Close();
     TError SetNs(int type = 0) const;
     TError Chroot() const;
@@ -14,6 +14,7 @@ extern "C" {
 #include <linux/if.h>
 #include <linux/if_ether.h>
 #include <linux/if_addrlabel.h>
+#include <linux/if_link.h>
 #include <netinet/ether.h>
 #include <netlink/route/class.h>
 #include <netlink/route/classifier.h>
@@ -225,6 +226,80 @@ free_msg:
     return error;
 }
 
+#ifdef RTM_GETSTATS
+static int ParseLinkStats(struct nl_msg *msg, void *data) {
+    auto stats = (std::map<int, TNlLinkStat> *)data;
+    struct nlmsghdr *hdr = nlmsg_hdr(msg);
+    struct if_stats_msg *ifsm;
+    struct rtnl_link_stats64 st;
+    struct nlattr *attr;
+
+    if (hdr->nlmsg_type != RTM_NEWSTATS ||
+            nlmsg_datalen(hdr) < (int)sizeof(*ifsm))
+        return NL_SKIP;
+
+    ifsm = (struct if_stats_msg *)nlmsg_data(hdr);
+    attr = nlmsg_find_attr(hdr, sizeof(*ifsm), IFLA_STATS_LINK_64);
+    if (!attr || nla_len(attr) < (int)sizeof(st))
+        return NL_SKIP;
+
+    memcpy(&st, nla_data(attr), sizeof(st));
+
+    auto &stat = (*stats)[ifsm->ifindex];
+    stat.RxPackets = st.rx_packets;
+    stat.RxBytes = st.rx_bytes;
+    stat.RxDrops = st.rx_dropped;
+    stat.TxPackets = st.tx_packets;
+    stat.TxBytes = st.tx_bytes;
+    stat.TxDrops = st.tx_dropped;
+
+    return NL_OK;
+}
+#endif
+
+/* Single RTM_GETSTATS dump with only 64-bit link counters */
+TError TNl::GetLinkStats(std::map<int, TNlLinkStat> &stats) {
+#ifdef RTM_GETSTATS
+    struct if_stats_msg ifsm;
+    struct nl_msg *msg;
+    struct nl_cb *cb;
+    int ret;
+
+    memset(&ifsm, 0, sizeof(ifsm));
+    ifsm.family = AF_UNSPEC;
+    ifsm.filter_mask = IFLA_STATS_FILTER_BIT(IFLA_STATS_LINK_64);
+
+    msg = nlmsg_alloc_simple(RTM_GETSTATS, NLM_F_DUMP);
+    if (!msg)
+        return TError(EError::Unknown, "nlmsg_alloc_simple getstats");
+
+    ret = nlmsg_append(msg, &ifsm, sizeof(ifsm), NLMSG_ALIGNTO);
+    if (ret < 0) {
+        nlmsg_free(msg);
+        return Error(ret, "nlmsg_append getstats");
+    }
+
+    ret = nl_send_auto(Sock, msg);
+    nlmsg_free(msg);
+    if (ret < 0)
+        return Error(ret, "nl_send_auto getstats");
+
+    cb = nl_cb_alloc(NL_CB_DEFAULT);
+    if (!cb)
+        return TError(EError::Unknown, "nl_cb_alloc getstats");
+
+    nl_cb_set(cb, NL_CB_VALID, NL_CB_CUSTOM, ParseLinkStats, &stats);
+    ret = nl_recvmsgs(Sock, cb);
+    nl_cb_put(cb);
+    if (ret < 0)
+        return Error(ret, "nl_recvmsgs getstats");
+
+    return TError::Success();
+#else
+    return TError(EError::NotSupported, "RTM_GETSTATS is not supported");
+#endif
+}
+
 int TNl::GetFd() {
     return nl_socket_get_fd(Sock);
 }
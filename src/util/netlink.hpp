@@ -3,6 +3,7 @@
 #include <string>
 #include <functional>
 #include <memory>
+#include <map>
 
 #include "common.hpp"
 extern "C" {
@@ -45,6 +46,15 @@ public:
 
 uint32_t TcHandle(uint16_t maj, uint16_t min);
 
+struct TNlLinkStat {
+    uint64_t RxPackets = 0;
+    uint64_t RxBytes = 0;
+    uint64_t RxDrops = 0;
+    uint64_t TxPackets = 0;
+    uint64_t TxBytes = 0;
+    uint64_t TxDrops = 0;
+};
+
 class TNl : public std::enable_shared_from_this<TNl>,
             public TNonCopyable {
     struct nl_sock *Sock = nullptr;
@@ -70,6 +80,7 @@ public:
     TError PermanentNeighbour(int ifindex, const TNlAddr &addr,
                               const TNlAddr &lladdr, bool add);
     TError AddrLabel(const TNlAddr &prefix, uint32_t label);
+    TError GetLinkStats(std::map<int, TNlLinkStat> &stats);
 };
 
 class TNlLink : public TNonCopyable {
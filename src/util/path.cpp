@@ -1,5 +1,9 @@
 #include <sstream>
 #include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 
 #include "path.hpp"
 #include "util/string.hpp"
@@ -245,6 +249,16 @@ TError TPath::Chmod(const int mode) const {
     return TError::Success();
 }
 
+/* Set atime to now, mtime is kept */
+TError TPath::TouchAccess() const {
+    struct timespec ts[2] = { { 0, UTIME_NOW }, { 0, UTIME_OMIT } };
+
+    if (utimensat(AT_FDCWD, Path.c_str(), ts, 0))
+        return TError(EError::Unknown, errno, "utimensat(" + Path + ")");
+
+    return TError::Success();
+}
+
 TError TPath::ReadLink(TPath &value) const {
     char buf[PATH_MAX];
     ssize_t len;
@@ -266,6 +280,13 @@ TError TPath::Symlink(const TPath &target) const {
     return TError::Success();
 }
 
+TError TPath::Hardlink(const TPath &target) const {
+    int ret = link(target.c_str(), Path.c_str());
+    if (ret)
+        return TError(EError::Unknown, errno, "link(" + target.ToString() + ", " + Path + ")");
+    return TError::Success();
+}
+
 TError TPath::Mknod(unsigned int mode, unsigned int dev) const {
     int ret = mknod(Path.c_str(), mode, dev);
     if (ret)
@@ -482,129 +503,321 @@ TError TPath::Rmdir() const {
 }
 
 /*
- * Removes everything in the directory but not directory itself.
- * Works only on one filesystem and aborts if sees mountpint.
+ * Parallel tree walk. Every directory is scanned exactly once with
+ * getdents64, all operations are relative to directory fds without
+ * following symlinks. Subdirectories are pushed into shared LIFO stack
+ * which keeps few fds open. Each directory holds counter of unfinished
+ * children, thread which drops it to zero calls Leave for directory.
  */
-TError TPath::ClearDirectory() const {
-    int top_fd, dir_fd, sub_fd;
-    DIR *top = NULL, *dir;
-    struct dirent *de;
-    struct stat top_st, st;
-    TError error = TError::Success();
 
-    L_ACT() << "clear directory " << Path << std::endl;
+struct TWalkNode {
+    std::shared_ptr<TWalkNode> Parent;
+    std::string Name;
+    TFile Dir;
+    std::atomic<int> Pending;
 
-    top_fd = open(Path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC |
-                                O_NOFOLLOW | O_NOATIME);
-    if (top_fd < 0)
-        return TError(EError::Unknown, errno, "ClearDirectory open(" + Path + ")");
+    TWalkNode(std::shared_ptr<TWalkNode> parent, const std::string &name) :
+        Parent(parent), Name(name), Pending(1) {}
+};
 
-    if (fstat(top_fd, &top_st)) {
-        close(top_fd);
-        return TError(EError::Unknown, errno, "ClearDirectory fstat(" + Path + ")");
+class TTreeWalker {
+    const int Threads;
+    dev_t Dev = 0;
+
+    std::mutex Mutex;
+    std::condition_variable Cv;
+    std::vector<std::shared_ptr<TWalkNode>> Stack;
+    int Idle = 0;
+    bool Done = false;
+    TError Error;
+
+    void Fail(const TError &error) {
+        std::unique_lock<std::mutex> lock(Mutex);
+        if (!Error)
+            Error = error;
+        Done = true;
+        Stack.clear();
+        Cv.notify_all();
     }
 
-    dir_fd = top_fd;
+    bool Failed() {
+        std::unique_lock<std::mutex> lock(Mutex);
+        return Done && Error;
+    }
 
-deeper:
-    dir = fdopendir(dir_fd);
-    if (dir == NULL) {
-        close(dir_fd);
-        if (dir_fd != top_fd)
-            closedir(top);
-        return TError(EError::Unknown, errno, "ClearDirectory fdopendir(" + Path + "/.../)");
+    void Release(std::shared_ptr<TWalkNode> node) {
+        while (node->Parent && --node->Pending == 0) {
+            node->Dir.Close();
+            TError error = Leave(*node->Parent, node->Name);
+            if (error) {
+                Fail(error);
+                return;
+            }
+            node = node->Parent;
+        }
     }
 
-restart:
-    while ((de = readdir(dir))) {
-        if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
-            continue;
+    void Push(std::shared_ptr<TWalkNode> node) {
+        std::unique_lock<std::mutex> lock(Mutex);
+        if (Done)
+            return;
+        Stack.push_back(node);
+        Cv.notify_one();
+    }
 
-        if (fstatat(dir_fd, de->d_name, &st, AT_SYMLINK_NOFOLLOW)) {
-            if (errno == ENOENT)
-                continue;
-            error = TError(EError::Unknown, errno, "ClearDirectory fstatat(" +
-                                          Path + "/.../" + de->d_name + ")");
-            break;
+    std::shared_ptr<TWalkNode> Pop() {
+        std::unique_lock<std::mutex> lock(Mutex);
+        while (!Done && Stack.empty()) {
+            if (++Idle == Threads) {
+                Done = true;
+                Cv.notify_all();
+                break;
+            }
+            Cv.wait(lock);
+            Idle--;
         }
+        if (Done)
+            return nullptr;
+        auto node = Stack.back();
+        Stack.pop_back();
+        return node;
+    }
+
+    TError Scan(std::shared_ptr<TWalkNode> node) {
+        struct stat st;
+        TError error;
+
+        if (node->Parent) {
+            error = node->Dir.OpenAt(node->Parent->Dir, node->Name,
+                    O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW | O_NOATIME);
+            if (error && error.GetErrno() == EPERM)
+                error = node->Dir.OpenAt(node->Parent->Dir, node->Name,
+                        O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW);
+            if (error) {
+                /* Replaced with something else meanwhile */
+                if (error.GetErrno() == ENOTDIR || error.GetErrno() == ELOOP)
+                    error = Visit(*node->Parent, node->Name, DT_UNKNOWN);
+                if (error && error.GetErrno() == ENOENT)
+                    error = TError::Success();
+                if (!error)
+                    Release(node->Parent);
+                return error;
+            }
+
+            if (fstat(node->Dir.Fd, &st))
+                return TError(EError::Unknown, errno, "fstat(" + Top.ToString() +
+                              "/.../" + node->Name + ")");
 
-        if (st.st_dev != top_st.st_dev) {
-            error = TError(EError::Unknown, EXDEV, "ClearDirectory found mountpoint in " + Path);
-            break;
+            if (st.st_dev != Dev) {
+                error = Mountpoint(node->Name);
+                if (!error)
+                    Release(node->Parent);
+                return error;
+            }
         }
 
-        if (Verbose)
-            L_ACT() << "clear directory: unlink " << de->d_name << std::endl;
-        if (!unlinkat(dir_fd, de->d_name, S_ISDIR(st.st_mode) ? AT_REMOVEDIR : 0))
-            continue;
+        error = Enter(*node);
+        if (error)
+            return error;
 
-        if (errno == ENOENT)
-            continue;
+        char buf[65536];
+        long len;
 
-        if (errno == EPERM || errno == EACCES) {
-            sub_fd = openat(dir_fd, de->d_name, O_RDONLY | O_CLOEXEC |
-                                    O_NOFOLLOW | O_NOCTTY | O_NONBLOCK);
-            if (sub_fd >= 0) {
-                error = TFile::Chattr(sub_fd, 0, FS_APPEND_FL | FS_IMMUTABLE_FL);
-                close(sub_fd);
+        while ((len = syscall(SYS_getdents64, node->Dir.Fd, buf, sizeof(buf))) > 0) {
+            for (long off = 0; off < len; ) {
+                auto de = (struct dirent64 *)(buf + off);
+                off += de->d_reclen;
+
+                if (!strcmp(de->d_name, ".") || !strcmp(de->d_name, ".."))
+                    continue;
+
+                unsigned char type = de->d_type;
+                if (type == DT_UNKNOWN) {
+                    if (fstatat(node->Dir.Fd, de->d_name, &st, AT_SYMLINK_NOFOLLOW)) {
+                        if (errno == ENOENT)
+                            continue;
+                        return TError(EError::Unknown, errno, "fstatat(" +
+                                      Top.ToString() + "/.../" + de->d_name + ")");
+                    }
+                    type = IFTODT(st.st_mode);
+                }
+
+                if (type == DT_DIR) {
+                    node->Pending++;
+                    Push(std::make_shared<TWalkNode>(node, de->d_name));
+                    continue;
+                }
+
+                error = Visit(*node, de->d_name, type);
                 if (error)
-                    L_ERR() << "Cannot change "  << de->d_name <<
-                        " attributes: " << error << std::endl;
+                    return error;
             }
-            error = TFile::Chattr(dir_fd, 0, FS_APPEND_FL | FS_IMMUTABLE_FL);
-            if (error)
-                L_ERR() << "Cannot change directory attributes: " << error << std::endl;
 
-            if (!unlinkat(dir_fd, de->d_name, S_ISDIR(st.st_mode) ? AT_REMOVEDIR : 0))
-                continue;
+            if (Failed())
+                return TError::Success();
         }
 
-        if (!S_ISDIR(st.st_mode) || (errno != ENOTEMPTY && errno != EEXIST)) {
-            error = TError(EError::Unknown, errno, "ClearDirectory unlinkat(" +
-                           Path + "/.../" + de->d_name + ")");
-            break;
-        }
+        if (len < 0)
+            return TError(EError::Unknown, errno, "getdents64(" +
+                          Top.ToString() + "/.../" + node->Name + ")");
 
-        sub_fd = openat(dir_fd, de->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC |
-                                            O_NOFOLLOW | O_NOATIME);
-        if (sub_fd >= 0) {
-            if (dir_fd != top_fd)
-                closedir(dir); /* closes dir_fd */
-            else
-                top = dir;
-            dir_fd = sub_fd;
-            if (Verbose)
-                L_ACT() << "clear directory: enter " << de->d_name << std::endl;
-            goto deeper;
+        Release(node);
+        return TError::Success();
+    }
+
+    void Work() {
+        while (auto node = Pop()) {
+            TError error = Scan(node);
+            if (error)
+                Fail(error);
         }
-        if (errno == ENOENT)
-            continue;
+    }
+
+protected:
+    const TPath &Top;
+
+    /* Directory is opened, called before scanning its content */
+    virtual TError Enter(TWalkNode &dir) { return TError::Success(); }
+
+    /* Non-directory entry, DT_UNKNOWN if directory was replaced */
+    virtual TError Visit(TWalkNode &dir, const std::string &name, unsigned char type) = 0;
+
+    /* All content of subdirectory is done */
+    virtual TError Leave(TWalkNode &dir, const std::string &name) { return TError::Success(); }
+
+    /* Subdirectory on other filesystem, skipped if returns success */
+    virtual TError Mountpoint(const std::string &name) { return TError::Success(); }
+
+public:
+    TTreeWalker(const TPath &top, int threads) :
+        Threads(std::max(threads, 1)), Top(top) {}
+
+    virtual ~TTreeWalker() {}
+
+    TError Run() {
+        auto root = std::make_shared<TWalkNode>(nullptr, ".");
+        struct stat st;
 
-        error = TError(EError::Unknown, errno, "ClearDirectory openat(" +
-                       Path + "/.../" + de->d_name + ")");
-        break;
+        TError error = root->Dir.Open(Top, O_RDONLY | O_DIRECTORY | O_CLOEXEC |
+                                           O_NOFOLLOW | O_NOATIME);
+        if (error && error.GetErrno() == EPERM)
+            error = root->Dir.Open(Top, O_RDONLY | O_DIRECTORY | O_CLOEXEC | O_NOFOLLOW);
+        if (error)
+            return TError(EError::Unknown, error.GetErrno(), "open(" + Top.ToString() + ")");
+
+        if (fstat(root->Dir.Fd, &st))
+            return TError(EError::Unknown, errno, "fstat(" + Top.ToString() + ")");
+        Dev = st.st_dev;
+
+        Stack.push_back(root);
+
+        std::vector<std::thread> workers;
+        for (int i = 1; i < Threads; i++)
+            workers.emplace_back(&TTreeWalker::Work, this);
+        Work();
+        for (auto &thread: workers)
+            thread.join();
+
+        return Error;
     }
+};
 
-    closedir(dir); /* closes dir_fd */
+class TTreeCleaner : public TTreeWalker {
+    const std::function<bool()> &Progress;
 
-    if (dir_fd != top_fd) {
-        if (!error) {
-            rewinddir(top);
-            dir = top;
-            dir_fd = top_fd;
-            if (Verbose)
-                L_ACT() << "clear directory: restart " << Path << std::endl;
-            goto restart; /* Restart from top directory */
+    TError Unlink(const TFile &dir, const std::string &name, bool directory) {
+        TError error = dir.UnlinkAt(name, directory);
+
+        if (error && (error.GetErrno() == EPERM || error.GetErrno() == EACCES)) {
+            TFile sub;
+            if (!sub.OpenAt(dir, name, O_RDONLY | O_CLOEXEC | O_NOFOLLOW |
+                                       O_NOCTTY | O_NONBLOCK)) {
+                error = TFile::Chattr(sub.Fd, 0, FS_APPEND_FL | FS_IMMUTABLE_FL);
+                if (error)
+                    L_ERR() << "Cannot change "  << name << " attributes: " << error << std::endl;
+            }
+            error = TFile::Chattr(dir.Fd, 0, FS_APPEND_FL | FS_IMMUTABLE_FL);
+            if (error)
+                L_ERR() << "Cannot change directory attributes: " << error << std::endl;
+            error = dir.UnlinkAt(name, directory);
         }
-        closedir(top); /* closes top_fd */
+
+        if (error && error.GetErrno() == ENOENT)
+            return TError::Success();
+
+        if (!error && Progress && !Progress())
+            return TError(EError::Unknown, ECANCELED, "ClearDirectory canceled " + Top.ToString());
+
+        return error;
     }
 
-    return error;
+    TError Enter(TWalkNode &dir) override {
+        if (Verbose)
+            L_ACT() << "clear directory: enter " << dir.Name << std::endl;
+        return TError::Success();
+    }
+
+    TError Visit(TWalkNode &dir, const std::string &name, unsigned char type) override {
+        if (Verbose)
+            L_ACT() << "clear directory: unlink " << name << std::endl;
+        return Unlink(dir.Dir, name, false);
+    }
+
+    TError Leave(TWalkNode &dir, const std::string &name) override {
+        return Unlink(dir.Dir, name, true);
+    }
+
+    TError Mountpoint(const std::string &name) override {
+        return TError(EError::Unknown, EXDEV, "ClearDirectory found mountpoint in " + Top.ToString());
+    }
+
+public:
+    TTreeCleaner(const TPath &top, int threads, const std::function<bool()> &progress) :
+        TTreeWalker(top, threads), Progress(progress) {}
+};
+
+/*
+ * Removes everything in the directory but not directory itself.
+ * Works only on one filesystem and aborts if sees mountpint.
+ * Progress is called after each removed entry, false cancels removal.
+ */
+TError TPath::ClearDirectory(int threads, const std::function<bool()> &progress) const {
+    L_ACT() << "clear directory " << Path << std::endl;
+    return TTreeCleaner(*this, threads, progress).Run();
+}
+
+class TTreeVisitor : public TTreeWalker {
+    const std::function<TError(const TFile &dir, const std::string &name)> &Fn;
+
+    TError Enter(TWalkNode &dir) override {
+        return Fn(dir.Dir, ".");
+    }
+
+    TError Visit(TWalkNode &dir, const std::string &name, unsigned char type) override {
+        /* Opening sockets, fifos or devices fails or has side effects */
+        if (type != DT_REG)
+            return TError::Success();
+        return Fn(dir.Dir, name);
+    }
+
+public:
+    TTreeVisitor(const TPath &top, int threads,
+                 const std::function<TError(const TFile &dir, const std::string &name)> &fn) :
+        TTreeWalker(top, threads), Fn(fn) {}
+};
+
+/*
+ * Calls fn for every directory (with name ".") and every regular file
+ * in the tree on one filesystem, possibly from several threads at once.
+ */
+TError TPath::WalkParallel(int threads,
+        const std::function<TError(const TFile &dir, const std::string &name)> &fn) const {
+    return TTreeVisitor(*this, threads, fn).Run();
 }
 
-TError TPath::RemoveAll() const {
+TError TPath::RemoveAll(int threads) const {
     if (IsDirectoryStrict()) {
-        TError error = ClearDirectory();
+        TError error = ClearDirectory(threads);
         if (error)
             return error;
         return Rmdir();
@@ -800,6 +1013,52 @@ TError TPath::BindAll(const TPath &source) const {
     return TError::Success();
 }
 
+#ifndef __NR_open_tree
+#define __NR_open_tree 428
+#endif
+
+#ifndef __NR_move_mount
+#define __NR_move_mount 429
+#endif
+
+#ifndef OPEN_TREE_CLONE
+#define OPEN_TREE_CLONE         1
+#endif
+
+#ifndef OPEN_TREE_CLOEXEC
+#define OPEN_TREE_CLOEXEC       O_CLOEXEC
+#endif
+
+#ifndef AT_RECURSIVE
+#define AT_RECURSIVE            0x8000
+#endif
+
+#ifndef MOVE_MOUNT_F_EMPTY_PATH
+#define MOVE_MOUNT_F_EMPTY_PATH 0x00000004
+#endif
+
+/* Clone whole mount tree at source with open_tree() and attach with move_mount() */
+TError TPath::AttachClone(const TPath &source) const {
+    L_ACT() << "attach clone " << Path << " " << source << std::endl;
+
+    int fd = syscall(__NR_open_tree, AT_FDCWD, source.c_str(),
+                     OPEN_TREE_CLONE | OPEN_TREE_CLOEXEC | AT_RECURSIVE);
+    if (fd < 0)
+        return TError(errno == ENOSYS ? EError::NotSupported : EError::Unknown,
+                      errno, "open_tree(" + source.ToString() + ")");
+
+    int ret = syscall(__NR_move_mount, fd, "", AT_FDCWD, Path.c_str(),
+                      MOVE_MOUNT_F_EMPTY_PATH);
+    int err = errno;
+    close(fd);
+
+    if (ret)
+        return TError(EError::Unknown, err, "move_mount(" + source.ToString() +
+                      ", " + Path + ")");
+
+    return TError::Success();
+}
+
 TError TPath::Remount(unsigned long flags) const {
     L_ACT() << "remount " << Path << " "
             << MountFlagsToString(flags) << std::endl;
@@ -1037,6 +1296,25 @@ TError TFile::OpenDir(const TPath &path) {
     return Open(path, O_RDONLY | O_CLOEXEC | O_DIRECTORY | O_NOCTTY);
 }
 
+TError TFile::OpenPath(const TPath &path) {
+    return Open(path, O_PATH | O_CLOEXEC | O_DIRECTORY | O_NOCTTY);
+}
+
+TError TFile::OpenAt(const TFile &dir, const std::string &name, int flags) {
+    if (Fd >= 0)
+        close(Fd);
+    SetFd = openat(dir.Fd, name.c_str(), flags);
+    if (Fd < 0)
+        return TError(EError::Unknown, errno, "Cannot open " + name);
+    return TError::Success();
+}
+
+TError TFile::UnlinkAt(const std::string &name, bool directory) const {
+    if (unlinkat(Fd, name.c_str(), directory ? AT_REMOVEDIR : 0))
+        return TError(EError::Unknown, errno, "unlinkat(" + name + ")");
+    return TError::Success();
+}
+
 #ifndef O_TMPFILE
 #define O_TMPFILE (O_DIRECTORY | 020000000)
 #endif
@@ -3,6 +3,7 @@
 #include <string>
 #include <vector>
 #include <list>
+#include <functional>
 
 #include "util/error.hpp"
 #include "util/cred.hpp"
@@ -24,6 +25,7 @@ struct TStatFS {
 };
 
 struct TMount;
+class TFile;
 
 class TPath {
     std::string Path;
@@ -139,8 +141,10 @@ public:
     }
 
     TError Chmod(const int mode) const;
+    TError TouchAccess() const;
     TError ReadLink(TPath &value) const;
     TError Symlink(const TPath &target) const;
+    TError Hardlink(const TPath &target) const;
     TError Mknod(unsigned int mode, unsigned int dev) const;
     TError Mkfile(unsigned int mode) const;
     TError Mkdir(unsigned int mode) const;
@@ -149,11 +153,14 @@ public:
     TError CreateAll(unsigned int mode) const;
     TError Rmdir() const;
     TError Unlink() const;
-    TError RemoveAll() const;
+    TError RemoveAll(int threads = 1) const;
     TError Rename(const TPath &dest) const;
     TError ReadDirectory(std::vector<std::string> &result) const;
     TError ListSubdirs(std::vector<std::string> &result) const;
-    TError ClearDirectory() const;
+    TError ClearDirectory(int threads = 1,
+                          const std::function<bool()> &progress = nullptr) const;
+    TError WalkParallel(int threads,
+            const std::function<TError(const TFile &dir, const std::string &name)> &fn) const;
     TError StatFS(TStatFS &result) const;
     TError SetXAttr(const std::string name, const std::string value) const;
     TError Truncate(off_t size) const;
@@ -173,6 +180,7 @@ public:
                  const std::vector<std::string> &options) const;
     TError Bind(const TPath &source) const;
     TError BindAll(const TPath &source) const;
+    TError AttachClone(const TPath &source) const;
     TError Remount(unsigned long flags) const;
     TError BindRemount(const TPath &source, unsigned long flags) const;
     TError Umount(unsigned long flags) const;
@@ -216,6 +224,9 @@ public:
     TError OpenTrunc(const TPath &path);
     TError OpenAppend(const TPath &path);
     TError OpenDir(const TPath &path);
+    TError OpenPath(const TPath &path);
+    TError OpenAt(const TFile &dir, const std::string &name, int flags);
+    TError UnlinkAt(const std::string &name, bool directory) const;
     TError CreateTemp(const TPath &path);
     TError CreateNew(const TPath &path, int mode);
     void Close(void);
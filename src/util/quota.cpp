@@ -1,3 +1,5 @@
+#include <atomic>
+
 #include "quota.hpp"
 
 extern "C" {
@@ -8,7 +10,6 @@ extern "C" {
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <unistd.h>
-#include <fts.h>
 }
 
 #ifndef PRJQUOTA
@@ -139,69 +140,54 @@ TError TProjectQuota::GetProjectId(const TPath &path, uint32_t &id) {
 	return TError::Success();
 }
 
-TError TProjectQuota::SetProjectIdOne(const char *path, uint32_t id) {
+TError TProjectQuota::SetProjectIdAt(const TFile &dir, const std::string &name, uint32_t id) {
 	struct fsxattr attr;
-	int fd, ret;
-	TError error;
+	TFile file;
+	int ret;
 
-	fd = open(path, O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NOFOLLOW |
-			O_NOATIME | O_NONBLOCK);
-	if (fd < 0 && errno == EPERM)
-		fd = open(path, O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NOFOLLOW |
-				O_NONBLOCK);
-	if (fd < 0)
-		return TError(EError::Unknown, errno, "Cannot open: " + std::string(path));
+	TError error = file.OpenAt(dir, name, O_RDONLY | O_CLOEXEC | O_NOCTTY |
+				   O_NOFOLLOW | O_NOATIME | O_NONBLOCK);
+	if (error && error.GetErrno() == EPERM)
+		error = file.OpenAt(dir, name, O_RDONLY | O_CLOEXEC | O_NOCTTY |
+				    O_NOFOLLOW | O_NONBLOCK);
+	if (error)
+		return error;
 
-	ret = ioctl(fd, FS_IOC_FSGETXATTR, &attr);
-	if (!ret) {
+	ret = ioctl(file.Fd, FS_IOC_FSGETXATTR, &attr);
+	if (!ret && (attr.fsx_projid != id ||
+		     !(attr.fsx_xflags & FS_XFLAG_PROJINHERIT))) {
 		attr.fsx_xflags |= FS_XFLAG_PROJINHERIT;
 		attr.fsx_projid = id;
-		ret = ioctl(fd, FS_IOC_FSSETXATTR, &attr);
+		ret = ioctl(file.Fd, FS_IOC_FSSETXATTR, &attr);
 	}
 	if (ret)
-		error = TError(EError::Unknown, errno, "Cannot set quota id: " + std::string(path));
-	close(fd);
-	return error;
+		return TError(EError::Unknown, errno, "Cannot set quota id: " + name);
+	return TError::Success();
 }
 
-TError TProjectQuota::SetProjectIdAll(const TPath &path, uint32_t id) {
-	const char *paths[] = { path.c_str(), NULL };
-	TError error;
+/*
+ * Parallel walk, progress is called with count of processed inodes
+ * after each batch and for the last partial one, returning false cancels
+ * assignment.
+ */
+TError TProjectQuota::SetProjectIdAll(const TPath &path, uint32_t id, int threads,
+				      const std::function<bool(uint64_t)> &progress) {
+	std::atomic<uint64_t> count(0);
+
+	TError error = path.WalkParallel(threads, [&] (const TFile &dir, const std::string &name) {
+		TError error = SetProjectIdAt(dir, name, id);
+		if (error && error.GetErrno() == ENOENT)
+			error = TError::Success();
+		if (!error && !(++count % 1024) && progress && !progress(count))
+			error = TError(EError::Unknown, ECANCELED,
+				       "Project id assignment canceled: " + path.ToString());
+		return error;
+	});
+
+	/* Report last partial batch */
+	if (!error && (count % 1024) && progress)
+		(void)progress(count);
 
-	FTS *fts = fts_open((char**)paths, FTS_PHYSICAL | FTS_NOCHDIR | FTS_XDEV, NULL);
-	if (!fts)
-		return TError(EError::Unknown, errno, "fts_open");
-
-	do {
-		FTSENT *ent = fts_read(fts);
-		if (ent == NULL) {
-			if (errno)
-				error = TError(EError::Unknown, errno, "fts_read");
-			break;
-		}
-		switch (ent->fts_info) {
-			case FTS_D:
-			case FTS_F:
-				error = SetProjectIdOne(ent->fts_accpath, id);
-				break;
-			case FTS_DC:
-			case FTS_NS:
-			case FTS_DNR:
-			case FTS_ERR:
-			case FTS_NSOK:
-				error = TError(EError::Unknown, errno,
-						"SetProjectId walk error: " +
-						std::string(ent->fts_accpath));
-				break;
-			case FTS_DP:
-			case FTS_SL:
-			case FTS_SLNONE:
-			case FTS_DEFAULT:
-			case FTS_DOT:
-				break;
-		}
-	} while (!error);
-	fts_close(fts);
 	return error;
 }
 
@@ -296,7 +282,7 @@ TError TProjectQuota::Load() {
 	return TError::Success();
 }
 
-TError TProjectQuota::Create() {
+TError TProjectQuota::Create(bool assign) {
 	struct if_dqblk quota;
 	TError error;
 
@@ -333,7 +319,7 @@ TError TProjectQuota::Create() {
 					std::to_string(CurrentId));
 
 		/* Reset current project id */
-		error = SetProjectIdAll(Path, 0);
+		error = SetProjectIdAll(Path, 0, Threads);
 		if (error)
 			return error;
 	}
@@ -355,14 +341,34 @@ TError TProjectQuota::Create() {
 
 	quotactl(QCMD(Q_SYNC, PRJQUOTA), Device.c_str(), 0, NULL);
 
-	/* Move files into project */
-	error = SetProjectIdAll(Path, ProjectId);
+	/* Move files into project, or only the top directory for now */
+	if (assign) {
+		error = Assign();
+	} else {
+		TFile dir;
+		error = dir.OpenDir(Path);
+		if (!error)
+			error = SetProjectIdAt(dir, ".", ProjectId);
+	}
 	if (error)
 		(void)Destroy();
 
 	return error;
 }
 
+/* Move existing content into project created without assignment */
+TError TProjectQuota::Assign(const std::function<bool(uint64_t)> &progress) {
+	TError error;
+
+	if (!ProjectId) {
+		error = FindProject();
+		if (error)
+			return error;
+	}
+
+	return SetProjectIdAll(Path, ProjectId, Threads, progress);
+}
+
 TError TProjectQuota::Resize() {
 	struct if_dqblk quota;
 	TError error;
@@ -400,7 +406,7 @@ TError TProjectQuota::Destroy() {
 	if (error)
 		return error;
 
-	error = SetProjectIdAll(Path, 0);
+	error = SetProjectIdAll(Path, 0, Threads);
 	if (error)
 		return error;
 
@@ -16,8 +16,9 @@ class TProjectQuota {
 
 	static TError InitProjectQuotaFile(TPath path);
 	static TError GetProjectId(const TPath &path, uint32_t &id);
-	static TError SetProjectIdOne(const char *path, uint32_t id);
-	static TError SetProjectIdAll(const TPath &path, uint32_t id);
+	static TError SetProjectIdAt(const TFile &dir, const std::string &name, uint32_t id);
+	static TError SetProjectIdAll(const TPath &path, uint32_t id, int threads,
+				      const std::function<bool(uint64_t)> &progress = nullptr);
 	static TError InventProjectId(const TPath &path, uint32_t &id);
 public:
 	TPath Path;
@@ -27,6 +28,7 @@ public:
 	uint64_t SpaceUsage = 0;
 	uint64_t InodeLimit = 0;
 	uint64_t InodeUsage = 0;
+	int Threads = 1;
 
 	TProjectQuota(const TPath &path) { Path = path; }
 
@@ -34,7 +36,8 @@ public:
 	bool Exists();
 
 	TError Load();
-	TError Create();
+	TError Create(bool assign = true);
+	TError Assign(const std::function<bool(uint64_t)> &progress = nullptr);
 	TError Resize();
 	TError Destroy();
 
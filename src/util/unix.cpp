@@ -145,6 +145,12 @@ uint64_t GetCurrentTimeMs() {
     return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
+uint64_t GetCurrentTimeUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
 bool WaitDeadline(uint64_t deadline, uint64_t wait) {
     uint64_t now = GetCurrentTimeMs();
     if (!deadline || int64_t(deadline - now) < 0)
@@ -232,10 +238,35 @@ bool FdHasEvent(int fd) {
     return pfd.revents != 0;
 }
 
+#ifndef __NR_pidfd_send_signal
+#define __NR_pidfd_send_signal 424
+#endif
+
+#ifndef __NR_pidfd_open
+#define __NR_pidfd_open 434
+#endif
+
+/* Pidfd is readable when process exits, since linux 5.3 */
+int PidfdOpen(pid_t pid) {
+    return syscall(__NR_pidfd_open, pid, 0);
+}
+
+int PidfdSendSignal(int pidfd, int signal) {
+    return syscall(__NR_pidfd_send_signal, pidfd, signal, NULL, 0);
+}
+
 TError SetOomScoreAdj(int value) {
     return TPath("/proc/self/oom_score_adj").WriteAll(std::to_string(value));
 }
 
+/* ioclass: 1 - realtime, 2 - best-effort, 3 - idle */
+TError SetIoPrio(pid_t pid, int ioclass, int level) {
+    if (syscall(SYS_ioprio_set, 1 /* IOPRIO_WHO_PROCESS */, pid,
+                (ioclass << 13) | level))
+        return TError(EError::Unknown, errno, "ioprio_set");
+    return TError::Success();
+}
+
 std::string FormatExitStatus(int status) {
     if (WIFSIGNALED(status))
         return StringFormat("exit signal: %d (%s)", WTERMSIG(status),
@@ -348,6 +379,42 @@ TError TUnixSocket::RecvInt(int &val) const {
     return TError::Success();
 }
 
+TError TUnixSocket::SendString(const std::string &str) const {
+    TError error = SendInt(str.size());
+    size_t off = 0;
+
+    while (!error && off < str.size()) {
+        ssize_t ret = write(SockFd, str.data() + off, str.size() - off);
+        if (ret <= 0)
+            return TError(EError::Unknown, errno, "cannot send string");
+        off += ret;
+    }
+
+    return error;
+}
+
+TError TUnixSocket::RecvString(std::string &str, size_t max_size) const {
+    size_t off = 0;
+    int size;
+
+    TError error = RecvInt(size);
+    if (error)
+        return error;
+
+    if (size < 0 || (size_t)size > max_size)
+        return TError(EError::Unknown, "invalid string size: " + std::to_string(size));
+
+    str.resize(size);
+    while (off < str.size()) {
+        ssize_t ret = read(SockFd, &str[off], str.size() - off);
+        if (ret <= 0)
+            return TError(EError::Unknown, errno, "cannot receive string");
+        off += ret;
+    }
+
+    return TError::Success();
+}
+
 TError TUnixSocket::SendPid(pid_t pid) const {
     struct iovec iovec = {
         .iov_base = &pid,
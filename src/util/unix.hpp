@@ -28,6 +28,7 @@ pid_t GetTid();
 TError GetTaskChildrens(pid_t pid, std::vector<pid_t> &childrens);
 
 uint64_t GetCurrentTimeMs();
+uint64_t GetCurrentTimeUs();
 bool WaitDeadline(uint64_t deadline, uint64_t sleep = 10);
 uint64_t GetTotalMemory();
 void SetProcessName(const std::string &name);
@@ -37,9 +38,12 @@ TError GetTaskCgroups(const int pid, std::map<std::string, std::string> &cgmap);
 std::string GetHostName();
 TError SetHostName(const std::string &name);
 bool FdHasEvent(int fd);
+int PidfdOpen(pid_t pid);
+int PidfdSendSignal(int pidfd, int signal);
 TError SetSysctl(const std::string &name, const std::string &value);
 
 TError SetOomScoreAdj(int value);
+TError SetIoPrio(pid_t pid, int ioclass, int level);
 
 std::string FormatExitStatus(int status);
 TError Popen(const std::string &cmd, std::vector<std::string> &lines);
@@ -66,5 +70,7 @@ public:
     TError RecvError() const;
     TError SendFd(int fd) const;
     TError RecvFd(int &fd) const;
+    TError SendString(const std::string &str) const;
+    TError RecvString(std::string &str, size_t max_size) const;
     TError SetRecvTimeout(int timeout_ms) const;
 };
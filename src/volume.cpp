@@ -12,6 +12,8 @@
 #include "config.hpp"
 #include "kvalue.hpp"
 #include "helpers.hpp"
+#include "statistics.hpp"
+#include "util/worker.hpp"
 
 extern "C" {
 #include <unistd.h>
@@ -34,7 +36,7 @@ TError TVolumeBackend::Configure() {
 }
 
 TError TVolumeBackend::Clear() {
-    return Volume->Path.ClearDirectory();
+    return Volume->Path.ClearDirectory(config().volumes().remove_threads());
 }
 
 TError TVolumeBackend::Save() {
@@ -77,7 +79,7 @@ public:
     }
 
     TError Clear() override {
-        return Volume->GetStorage().ClearDirectory();
+        return Volume->GetStorage().ClearDirectory(config().volumes().remove_threads());
     }
 
     TError Destroy() override {
@@ -300,11 +302,15 @@ public:
         if (Volume->HaveQuota()) {
             quota.SpaceLimit = Volume->SpaceLimit;
             quota.InodeLimit = Volume->InodeLimit;
+            quota.Threads = config().volumes().quota_threads();
             L_ACT() << "Creating project quota: " << quota.Path << " bytes: "
                     << quota.SpaceLimit << " inodes: " << quota.InodeLimit << std::endl;
-            error = quota.Create();
+            /* User storage might be large, move content into project later */
+            error = quota.Create(!Volume->HaveStorage());
             if (error)
                 return error;
+            if (Volume->HaveStorage())
+                Volume->AssignQuota();
         }
 
         error = storage.Chown(Volume->VolumeOwner);
@@ -319,7 +325,7 @@ public:
     }
 
     TError Clear() override {
-        return Volume->GetStorage().ClearDirectory();
+        return Volume->GetStorage().ClearDirectory(config().volumes().remove_threads());
     }
 
     TError Destroy() override {
@@ -331,6 +337,10 @@ public:
         if (error)
             L_ERR() << "Can't umount volume: " << error << std::endl;
 
+        /* Wait for cancellation of project id assignment */
+        std::unique_lock<std::mutex> lock(Volume->QuotaMutex);
+
+        quota.Threads = config().volumes().quota_threads();
         if (Volume->HaveQuota() && quota.Exists()) {
             L_ACT() << "Destroying project quota: " << quota.Path << std::endl;
             error = quota.Destroy();
@@ -348,14 +358,17 @@ public:
         quota.InodeLimit = inode_limit;
         if (!Volume->HaveQuota()) {
             L_ACT() << "Creating project quota: " << quota.Path << std::endl;
-            return quota.Create();
+            TError error = quota.Create(false);
+            if (!error)
+                Volume->AssignQuota();
+            return error;
         }
         L_ACT() << "Resizing project quota: " << quota.Path << std::endl;
         return quota.Resize();
     }
 
     TError StatFS(TStatFS &result) override {
-        if (Volume->HaveQuota())
+        if (Volume->HaveQuota() && !Volume->QuotaPending)
             return TProjectQuota(Volume->GetStorage()).StatFS(result);
         return Volume->Path.StatFS(result);
     }
@@ -443,6 +456,85 @@ public:
 
         return TError::Success();
 
+remove_file:
+        (void)path.Unlink();
+        return error;
+    }
+
+    /*
+     * Pre-formatted images per power-of-two size class, new image is
+     * cloned from largest class not exceeding its size and grown online.
+     * Online resize of small filesystems is buggy, they are made as before.
+     */
+    static constexpr off_t TemplateMinSize = 512ll << 20;
+
+    static TError GetTemplate(const TPath &place, off_t size,
+                              TPath &tmpl, off_t &tmpl_size) {
+        TPath dir = place / config().volumes().templates_dir();
+        TError error;
+
+        tmpl_size = TemplateMinSize;
+        while (tmpl_size * 2 <= size)
+            tmpl_size *= 2;
+
+        tmpl = dir / ("ext4-" + std::to_string(tmpl_size) + ".img");
+        if (tmpl.Exists())
+            return TError::Success();
+
+        if (!dir.IsDirectoryStrict()) {
+            error = dir.MkdirAll(0700);
+            if (error)
+                return error;
+        }
+
+        TPath temp = dir / (LAYER_TMP_PREFIX + tmpl.BaseName() + "-" +
+                            std::to_string(GetTid()));
+
+        L_ACT() << "Make loop image template " << tmpl << std::endl;
+        error = MakeImage(temp, TCred(RootUser, RootGroup), tmpl_size, 0);
+        if (!error)
+            error = temp.Rename(tmpl);
+        if (error)
+            (void)temp.Unlink();
+
+        return error;
+    }
+
+    static TError CloneImage(const TPath &tmpl, const TPath &path, const TCred &cred,
+                             off_t size, off_t guarantee) {
+        TFile src, image;
+        TError error;
+
+        error = src.OpenRead(tmpl);
+        if (error)
+            return error;
+
+        error = image.CreateNew(path, 0644);
+        if (error)
+            return error;
+
+        error = CloneFile(src, image);
+        if (error)
+            goto remove_file;
+
+        if (fchown(image.Fd, cred.Uid, cred.Gid)) {
+            error = TError(EError::Unknown, errno, "chown(" + path.ToString() + ")");
+            goto remove_file;
+        }
+
+        if (ftruncate(image.Fd, size)) {
+            error = TError(EError::Unknown, errno, "truncate(" + path.ToString() + ")");
+            goto remove_file;
+        }
+
+        if (guarantee && fallocate(image.Fd, FALLOC_FL_KEEP_SIZE, 0, guarantee)) {
+            error = TError(EError::ResourceNotAvailable, errno,
+                           "cannot fallocate guarantee " + std::to_string(guarantee));
+            goto remove_file;
+        }
+
+        return TError::Success();
+
 remove_file:
         (void)path.Unlink();
         return error;
@@ -470,6 +562,7 @@ remove_file:
     TError Build() override {
         TPath path = Volume->Path;
         TPath image = Volume->StorageFile;
+        bool cloned = false, grow = false;
         TError error;
 
         if (!image.Exists()) {
@@ -478,10 +571,30 @@ remove_file:
 
             L_ACT() << "Allocate loop image with size " << Volume->SpaceLimit
                     << " guarantee " << Volume->SpaceGuarantee << std::endl;
-            error = MakeImage(image, Volume->VolumeOwner,
-                              Volume->SpaceLimit, Volume->SpaceGuarantee);
-            if (error)
-                return error;
+
+            if (config().volumes().loop_templates() && !Volume->IsReadOnly &&
+                    (off_t)Volume->SpaceLimit >= TemplateMinSize) {
+                off_t tmpl_size;
+                TPath tmpl;
+
+                error = GetTemplate(Volume->Place, Volume->SpaceLimit, tmpl, tmpl_size);
+                if (!error)
+                    error = CloneImage(tmpl, image, Volume->VolumeOwner,
+                                       Volume->SpaceLimit, Volume->SpaceGuarantee);
+                if (error)
+                    L_WRN() << "Cannot clone loop image template: " << error << std::endl;
+                else {
+                    cloned = true;
+                    grow = (off_t)Volume->SpaceLimit > tmpl_size;
+                }
+            }
+
+            if (!cloned) {
+                error = MakeImage(image, Volume->VolumeOwner,
+                                  Volume->SpaceLimit, Volume->SpaceGuarantee);
+                if (error)
+                    return error;
+            }
 
         } else {
             struct stat st;
@@ -508,6 +621,12 @@ remove_file:
         if (error)
             goto free_loop;
 
+        if (grow) {
+            error = GrowExt4(path, Volume->SpaceLimit);
+            if (error)
+                goto umount_loop;
+        }
+
         if (!Volume->IsReadOnly) {
             error = path.Chown(Volume->VolumeOwner);
             if (error)
@@ -545,7 +664,7 @@ free_loop:
     }
 
     TError Clear() override {
-        return Volume->Path.ClearDirectory();
+        return Volume->Path.ClearDirectory(config().volumes().remove_threads());
     }
 
     TError Resize(uint64_t space_limit, uint64_t inode_limit) override {
@@ -554,7 +673,7 @@ free_loop:
         if (Volume->SpaceLimit < (512ul << 20))
             return TError(EError::InvalidProperty, "Refusing to online resize loop volume with initial limit < 512M (kernel bug)");
 
-        return ResizeLoopDev(LoopDev, Volume->StorageFile,
+        return ResizeLoopDev(LoopDev, Volume->StorageFile, Volume->Path,
                              Volume->SpaceLimit, space_limit);
     }
 
@@ -605,7 +724,7 @@ public:
         TPath work = storage / "work";
         TError error;
         std::stringstream lower;
-        int layer_idx = 0;
+        std::list<TFile> layers;
 
         if (Volume->HaveQuota()) {
             quota.SpaceLimit = Volume->SpaceLimit;
@@ -617,38 +736,35 @@ public:
                   return error;
         }
 
+        /*
+         * Layers are pinned by fds and passed as /proc/self/fd/N, so volume
+         * is assembled with single mount regardless of count of layers.
+         */
         for (auto &name: Volume->Layers) {
-            TPath path, temp;
-            TFile pin;
+            layers.emplace_back();
+            TFile &pin = layers.back();
 
             if (name[0] == '/') {
-                error = pin.OpenDir(name);
+                error = pin.OpenPath(name);
+                if (error)
+                    goto err;
                 if (Volume->CreatorRoot.InnerPath(pin.RealPath()).IsEmpty()) {
                     error = TError(EError::Permission, "Layer path outside root: " + name);
                     goto err;
                 }
-                path = pin.ProcPath();
-                if (!path.CanWrite(Volume->CreatorCred)) {
+                if (!pin.ProcPath().CanWrite(Volume->CreatorCred)) {
                     error = TError(EError::Permission, "Layer path not permitted: " + name);
                     goto err;
                 }
-            } else
-                path = Volume->Place / config().volumes().layers_dir() / name;
-
-            temp = Volume->GetInternal("layer_" + std::to_string(layer_idx++));
-            error = temp.Mkdir(700);
-            if (!error)
-                error = temp.BindRemount(path, MS_RDONLY | MS_NODEV);
-            if (!error)
-                error = temp.Remount(MS_PRIVATE);
-            if (error)
-                goto err;
-
-            pin.Close();
+            } else {
+                error = pin.OpenPath(Volume->Place / config().volumes().layers_dir() / name);
+                if (error)
+                    goto err;
+            }
 
-            if (layer_idx > 1)
+            if (layers.size() > 1)
                 lower << ":";
-            lower << StringReplaceAll(temp.ToString(), ":", "\\:");
+            lower << pin.ProcPath().ToString();
         }
 
         if (!upper.Exists()) {
@@ -678,12 +794,6 @@ public:
                                           "upperdir=" + upper.ToString(),
                                           "workdir=" + work.ToString() });
 err:
-        while (layer_idx--) {
-            TPath temp = Volume->GetInternal("layer_" + std::to_string(layer_idx));
-            (void)temp.UmountAll();
-            (void)temp.Rmdir();
-        }
-
         if (!error)
             return error;
 
@@ -693,7 +803,7 @@ err:
     }
 
     TError Clear() override {
-        return (Volume->GetStorage() / "upper").ClearDirectory();
+        return (Volume->GetStorage() / "upper").ClearDirectory(config().volumes().remove_threads());
     }
 
     TError Destroy() override {
@@ -707,7 +817,7 @@ err:
             L_ERR() << "Can't umount overlay: " << error << std::endl;
 
         if (!Volume->HaveStorage()) {
-            error2 = storage.ClearDirectory();
+            error2 = ClearToJunk(Volume->Place, storage);
             if (error2) {
                 if (!error)
                     error = error2;
@@ -737,14 +847,17 @@ err:
         quota.InodeLimit = inode_limit;
         if (!Volume->HaveQuota()) {
             L_ACT() << "Creating project quota: " << quota.Path << std::endl;
-            return quota.Create();
+            TError error = quota.Create(false);
+            if (!error)
+                Volume->AssignQuota();
+            return error;
         }
         L_ACT() << "Resizing project quota: " << quota.Path << std::endl;
         return quota.Resize();
     }
 
     TError StatFS(TStatFS &result) override {
-        if (Volume->HaveQuota())
+        if (Volume->HaveQuota() && !Volume->QuotaPending)
             return TProjectQuota(Volume->GetStorage()).StatFS(result);
         return Volume->Path.StatFS(result);
     }
@@ -851,7 +964,7 @@ public:
     }
 
     TError Clear() override {
-        return Volume->Path.ClearDirectory();
+        return Volume->Path.ClearDirectory(config().volumes().remove_threads());
     }
 
     TError Resize(uint64_t space_limit, uint64_t inode_limit) override {
@@ -928,12 +1041,185 @@ unsigned long TVolume::GetMountFlags(void) const {
     return flags;
 }
 
+/*
+ * Guarantees and claimed space of volumes are aggregated per device,
+ * claims are refreshed by background sampler, all under VolumesMutex.
+ */
+struct TDeviceGuarantee {
+    uint64_t SpaceGuarantee = 0;
+    uint64_t InodeGuarantee = 0;
+    uint64_t SpaceClaimed = 0;
+    uint64_t InodeClaimed = 0;
+    uint64_t Volumes = 0;
+};
+
+static std::map<dev_t, TDeviceGuarantee> DeviceGuarantees;
+
+static bool GuaranteeSupported(const std::string &backend) {
+    /* rbd stored remotely, tmpfs in memory */
+    return backend != "rbd" && backend != "tmpfs";
+}
+
+void TVolume::AccountGuarantee(void) {
+    /* Plain cannot provide usage, guarantee is checked but not reserved */
+    if (GuaranteeAccounted || !GuaranteeSupported(BackendType) ||
+            BackendType == "plain" || (!SpaceGuarantee && !InodeGuarantee))
+        return;
+
+    TPath storage = HaveStorage() ? GetStorage() :
+                    Place / config().volumes().volume_dir();
+
+    auto &dev = DeviceGuarantees[storage.GetDev()];
+
+    GuaranteeAccounted = true;
+    GuaranteeDevice = storage.GetDev();
+    SpaceGuaranteeAccounted = SpaceGuarantee;
+    InodeGuaranteeAccounted = BackendType == "loop" ? 0 : InodeGuarantee;
+    SpaceClaimed = 0;
+    InodeClaimed = 0;
+
+    dev.SpaceGuarantee += SpaceGuaranteeAccounted;
+    dev.InodeGuarantee += InodeGuaranteeAccounted;
+    dev.Volumes++;
+}
+
+void TVolume::UnaccountGuarantee(void) {
+    if (!GuaranteeAccounted)
+        return;
+
+    auto it = DeviceGuarantees.find(GuaranteeDevice);
+    PORTO_ASSERT(it != DeviceGuarantees.end());
+    auto &dev = it->second;
+
+    dev.SpaceGuarantee -= SpaceGuaranteeAccounted;
+    dev.InodeGuarantee -= InodeGuaranteeAccounted;
+    dev.SpaceClaimed -= SpaceClaimed;
+    dev.InodeClaimed -= InodeClaimed;
+    if (!--dev.Volumes)
+        DeviceGuarantees.erase(it);
+
+    GuaranteeAccounted = false;
+}
+
+void TVolume::ClaimGuarantee(const TStatFS &stat) {
+    if (!GuaranteeAccounted)
+        return;
+
+    auto &dev = DeviceGuarantees[GuaranteeDevice];
+
+    dev.SpaceClaimed -= SpaceClaimed;
+    dev.InodeClaimed -= InodeClaimed;
+    SpaceClaimed = std::min(stat.SpaceUsage, SpaceGuaranteeAccounted);
+    InodeClaimed = std::min(stat.InodeUsage, InodeGuaranteeAccounted);
+    dev.SpaceClaimed += SpaceClaimed;
+    dev.InodeClaimed += InodeClaimed;
+}
+
+/* Refresh claimed space, statfs is done without holding VolumesMutex */
+void TVolume::SampleGuarantees(void) {
+    std::vector<std::shared_ptr<TVolume>> volumes;
+
+    auto volumes_lock = LockVolumes();
+    for (auto &it: Volumes)
+        if (it.second->GuaranteeAccounted)
+            volumes.push_back(it.second);
+    volumes_lock.unlock();
+
+    for (auto &volume: volumes) {
+        TStatFS stat;
+
+        if (!volume->IsReady || volume->IsDying || volume->QuotaPending ||
+                volume->StatFS(stat))
+            continue;
+
+        volumes_lock.lock();
+        volume->ClaimGuarantee(stat);
+        volumes_lock.unlock();
+    }
+
+    Statistics->GuaranteeSamples++;
+}
+
+class TGuaranteeSampler : public TWorker<int> {
+public:
+    TGuaranteeSampler() : TWorker("portod-guarantee", 1) {}
+
+    void Wait(TScopedLock &lock) override {
+        if (Valid)
+            Cv.wait_for(lock, std::chrono::milliseconds(
+                        config().volumes().guarantee_sample_ms()));
+    }
+
+    const int &Top() override {
+        return Queue.front();
+    }
+
+    /* Never completes: requeued and handled again after timeout */
+    bool Handle(const int &) override {
+        TVolume::SampleGuarantees();
+        return false;
+    }
+};
+
+static TGuaranteeSampler GuaranteeSampler;
+
+void StartGuaranteeSampler() {
+    GuaranteeSampler.Push(0);
+    GuaranteeSampler.Start();
+}
+
+void StopGuaranteeSampler() {
+    GuaranteeSampler.Stop();
+}
+
+/* Project quota assignment walks have own pool, not to delay layer import */
+class TQuotaWorker : public TWorker<std::function<void()>> {
+public:
+    TQuotaWorker(size_t nr) : TWorker("portod-quota", nr) {}
+
+    const std::function<void()> &Top() override {
+        return Queue.front();
+    }
+
+    bool Handle(const std::function<void()> &task) override {
+        task();
+        return true;
+    }
+};
+
+static std::unique_ptr<TQuotaWorker> QuotaWorker;
+
+/* Assignments queued during restore are started together with workers */
+static void InitQuotaWorkers() {
+    if (!QuotaWorker)
+        QuotaWorker = std::unique_ptr<TQuotaWorker>(
+                new TQuotaWorker(std::max(1, config().volumes().quota_workers())));
+}
+
+void StartQuotaWorkers() {
+    InitQuotaWorkers();
+    QuotaWorker->Start();
+}
+
+void StopQuotaWorkers() {
+    if (QuotaWorker) {
+        QuotaWorker->Stop();
+        QuotaWorker = nullptr;
+    }
+}
+
+static void QueueQuotaTask(const std::function<void()> &task) {
+    InitQuotaWorkers();
+    QuotaWorker->Push(task);
+}
+
+/* Must be called under VolumesMutex */
 TError TVolume::CheckGuarantee(uint64_t space_guarantee, uint64_t inode_guarantee) const {
     auto backend = BackendType;
     TStatFS current, total;
     TPath storage;
 
-    if (backend == "rbd" || backend == "tmpfs")
+    if (!GuaranteeSupported(backend))
         return TError::Success();
 
     if (!space_guarantee && !inode_guarantee)
@@ -963,43 +1249,20 @@ TError TVolume::CheckGuarantee(uint64_t space_guarantee, uint64_t inode_guarante
                       std::to_string(total.InodeAvail) + " available " +
                       std::to_string(current.InodeUsage) + " used");
 
-    /* Estimate unclaimed guarantees */
+    /* Unclaimed guarantees of other volumes at this device */
     uint64_t space_claimed = 0, space_guaranteed = 0;
     uint64_t inode_claimed = 0, inode_guaranteed = 0;
-    for (auto &it: Volumes) {
-        auto volume = it.second;
-        if (volume.get() == this ||
-                volume->GetStorage().GetDev() != storage.GetDev())
-            continue;
-
-        auto volume_backend = volume->BackendType;
-
-        /* rbd stored remotely, plain cannot provide usage */
-        if (volume_backend == "rbd" || volume_backend == "plain")
-            continue;
-
-        TStatFS stat;
-        uint64_t volume_space_guarantee = SpaceGuarantee;
-        uint64_t volume_inode_guarantee = InodeGuarantee;
-
-        if (!volume_space_guarantee && !volume_inode_guarantee)
-            continue;
-
-        if (!volume->IsReady || volume->StatFS(stat))
-            stat.Reset();
-
-        space_guaranteed += volume_space_guarantee;
-        if (stat.SpaceUsage < volume_space_guarantee)
-            space_claimed += stat.SpaceUsage;
-        else
-            space_claimed += volume_space_guarantee;
-
-        if (volume_backend != "loop") {
-            inode_guaranteed += volume_inode_guarantee;
-            if (stat.InodeUsage < volume_inode_guarantee)
-                inode_claimed += stat.InodeUsage;
-            else
-                inode_claimed += volume_inode_guarantee;
+    auto it = DeviceGuarantees.find(storage.GetDev());
+    if (it != DeviceGuarantees.end()) {
+        space_guaranteed = it->second.SpaceGuarantee;
+        space_claimed = it->second.SpaceClaimed;
+        inode_guaranteed = it->second.InodeGuarantee;
+        inode_claimed = it->second.InodeClaimed;
+        if (GuaranteeAccounted && GuaranteeDevice == it->first) {
+            space_guaranteed -= SpaceGuaranteeAccounted;
+            space_claimed -= SpaceClaimed;
+            inode_guaranteed -= InodeGuaranteeAccounted;
+            inode_claimed -= InodeClaimed;
         }
     }
 
@@ -1296,6 +1559,11 @@ TError TVolume::Build() {
             return error;
     }
 
+    /* Update last usage for layer GC */
+    for (auto &name: Layers)
+        if (name[0] != '/')
+            TouchLayer(name, Place);
+
     IsReady = true;
 
     return Save();
@@ -1331,17 +1599,19 @@ TError TVolume::Destroy(void) {
     Volumes.erase(Path);
     plan.push_front(shared_from_this());
 
-    /* Remove sub-volumes */
-    for (auto it = Volumes.begin(); it != Volumes.end(); ) {
-        if (!Path.InnerPath(it->second->Path).IsEmpty()) {
-            plan.push_front(it->second);
-            it = Volumes.erase(it);
-        } else
-            ++it;
+    /* Remove sub-volumes, they are sorted right after prefix "path/" */
+    std::string prefix = Path.ToString();
+    if (prefix != "/")
+        prefix += "/";
+    for (auto it = Volumes.lower_bound(TPath(prefix));
+            it != Volumes.end() && !Path.InnerPath(it->first).IsEmpty(); ) {
+        plan.push_front(it->second);
+        it = Volumes.erase(it);
     }
 
     for (auto &volume: plan) {
         volume->IsDying = true;
+        volume->UnaccountGuarantee();
         for (auto &name: volume->Containers) {
             L_ACT()  << "Forced unlink volume " << volume->Path
                      << " from " << name << std::endl;
@@ -1392,7 +1662,7 @@ TError TVolume::DestroyOne(void) {
     }
 
     if (!HaveStorage() && storage.Exists()) {
-        error = storage.RemoveAll();
+        error = MoveToJunk(Place, storage);
         if (error) {
             L_ERR() << "Can't remove storage: " << error << std::endl;
             if (!ret)
@@ -1401,7 +1671,7 @@ TError TVolume::DestroyOne(void) {
     }
 
     if (IsAutoPath && Path.Exists()) {
-        error = Path.RemoveAll();
+        error = MoveToJunk(Place, Path);
         if (error) {
             L_ERR() << "Can't remove volume path: " << error << std::endl;
             if (!ret)
@@ -1410,7 +1680,7 @@ TError TVolume::DestroyOne(void) {
     }
 
     if (internal.Exists()) {
-        error = internal.RemoveAll();
+        error = MoveToJunk(Place, internal);
         if (error) {
             L_ERR() << "Can't remove internal: " << error << std::endl;
             if (!ret)
@@ -1491,12 +1761,16 @@ TError TVolume::Tune(const std::map<std::string, std::string> &properties) {
                 return error;
         }
 
+        auto volumes_lock = LockVolumes();
+
         error = CheckGuarantee(space_guarantee, inode_guarantee);
         if (error)
             return error;
 
+        UnaccountGuarantee();
         SpaceGuarantee = space_guarantee;
         InodeGuarantee = inode_guarantee;
+        AccountGuarantee();
     }
 
     return Save();
@@ -1516,6 +1790,54 @@ TError TVolume::Resize(uint64_t space_limit, uint64_t inode_limit) {
     return Save();
 }
 
+/*
+ * Move existing content into project quota in background,
+ * usage is not reported until assignment is complete.
+ */
+void TVolume::AssignQuota(void) {
+    auto volume = shared_from_this();
+
+    QuotaPending = true;
+
+    QueueQuotaTask([volume] () {
+        std::unique_lock<std::mutex> lock(volume->QuotaMutex);
+        TProjectQuota quota(volume->GetStorage());
+        uint64_t start = GetCurrentTimeMs(), last = 0;
+        TError error;
+
+        if (volume->IsDying)
+            return;
+
+        L_ACT() << "Assign project quota: " << quota.Path << std::endl;
+
+        quota.Threads = config().volumes().quota_threads();
+        error = quota.Assign([&] (uint64_t count) {
+            Statistics->QuotaInodesAssigned += count - last;
+            last = count;
+            if (!(count % (1 << 20)))
+                L_ACT() << "Project quota " << quota.Path << " assigned "
+                        << count << " inodes" << std::endl;
+            return !volume->IsDying;
+        });
+
+        if (error) {
+            if (!volume->IsDying)
+                L_ERR() << "Cannot assign project quota: " << error << std::endl;
+            return;
+        }
+
+        L_ACT() << "Project quota " << quota.Path << " assigned in "
+                << GetCurrentTimeMs() - start << "ms" << std::endl;
+
+        lock.unlock();
+
+        auto volume_lock = volume->ScopedLock();
+        volume->QuotaPending = false;
+        if (!volume->IsDying)
+            (void)volume->Save();
+    });
+}
+
 TError TVolume::GetUpperLayer(TPath &upper) {
     if (BackendType == "overlay")
         upper = GetStorage() / "upper";
@@ -1570,8 +1892,10 @@ TStringMap TVolume::DumpState(const TPath &root) {
     TStatFS stat;
 
     if (IsReady && !StatFS(stat)) {
-        ret[V_SPACE_USED] = std::to_string(stat.SpaceUsage);
-        ret[V_INODE_USED] = std::to_string(stat.InodeUsage);
+        if (!QuotaPending) {
+            ret[V_SPACE_USED] = std::to_string(stat.SpaceUsage);
+            ret[V_INODE_USED] = std::to_string(stat.InodeUsage);
+        }
         ret[V_SPACE_AVAILABLE] = std::to_string(stat.SpaceAvail);
         ret[V_INODE_AVAILABLE] = std::to_string(stat.InodeAvail);
     }
@@ -1641,6 +1965,9 @@ TError TVolume::Save() {
     node.Set(V_INODE_LIMIT, std::to_string(InodeLimit));
     node.Set(V_INODE_GUARANTEE, std::to_string(InodeGuarantee));
 
+    if (QuotaPending)
+        node.Set(V_QUOTA_PENDING, BoolToString(true));
+
     if (CustomPlace)
         node.Set(V_PLACE, Place.ToString());
 
@@ -1713,6 +2040,7 @@ TError TVolume::Create(const TPath &path, const TStringMap &cfg,
         return error;
 
     Volumes[volume->Path] = volume;
+    volume->AccountGuarantee();
 
     volumes_lock.unlock();
 
@@ -1772,6 +2100,7 @@ void TVolume::RestoreAll(void) {
         }
 
         Volumes[volume->Path] = volume;
+        volume->AccountGuarantee();
 
         auto containers_lock = LockContainers();
 
@@ -1792,6 +2121,9 @@ void TVolume::RestoreAll(void) {
             continue;
         }
 
+        if (volume->QuotaPending)
+            volume->AssignQuota();
+
         L() << "Volume " << volume->Path << " restored" << std::endl;
     }
 
@@ -1822,7 +2154,7 @@ void TVolume::RestoreAll(void) {
             if (error)
                 L_ERR() << "Cannot umount volume " << mnt << ": " << error << std::endl;
         }
-        error = dir.RemoveAll();
+        error = MoveToJunk(place, dir);
         if (error)
             L_ERR() << "Cannot remove directory " << dir << std::endl;
     }
@@ -1899,6 +2231,13 @@ TError TVolume::ApplyConfig(const TStringMap &cfg) {
             if (error)
                 return error;
 
+        } else if (prop.first == V_QUOTA_PENDING) {
+            bool pending;
+            error = StringToBool(prop.second, pending);
+            if (error)
+                return error;
+            QuotaPending = pending;
+
         } else if (prop.first == V_READ_ONLY) {
             error = StringToBool(prop.second, IsReadOnly);
             if (error)
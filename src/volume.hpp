@@ -1,6 +1,8 @@
 #pragma once
 
 #include <memory>
+#include <atomic>
+#include <mutex>
 #include <string>
 #include "common.hpp"
 #include "statistics.hpp"
@@ -16,6 +18,7 @@ constexpr const char *V_ID = "_id";
 constexpr const char *V_CONTAINERS = "_containers";
 constexpr const char *V_LOOP_DEV = "_loop_dev";
 constexpr const char *V_AUTO_PATH = "_auto_path";
+constexpr const char *V_QUOTA_PENDING = "_quota_pending";
 
 constexpr const char *V_USER = "user";
 constexpr const char *V_GROUP = "group";
@@ -89,7 +92,19 @@ public:
     bool CustomPlace = false;
     TPath Place;
 
-    TVolume() {
+    /* Existing content is being moved into project quota */
+    std::atomic<bool> QuotaPending;
+    std::mutex QuotaMutex;
+
+    /* Contribution into device guarantee aggregates, under VolumesMutex */
+    bool GuaranteeAccounted = false;
+    dev_t GuaranteeDevice = 0;
+    uint64_t SpaceGuaranteeAccounted = 0;
+    uint64_t InodeGuaranteeAccounted = 0;
+    uint64_t SpaceClaimed = 0;
+    uint64_t InodeClaimed = 0;
+
+    TVolume() : QuotaPending(false) {
         Statistics->VolumesCount++;
     }
     ~TVolume() {
@@ -129,8 +144,13 @@ public:
     TError Tune(const TStringMap &cfg);
 
     TError Resize(uint64_t space_limit, uint64_t inode_limit);
+    void AssignQuota(void);
 
     TError CheckGuarantee(uint64_t space_guarantee, uint64_t inode_guarantee) const;
+    void AccountGuarantee(void);
+    void UnaccountGuarantee(void);
+    void ClaimGuarantee(const TStatFS &stat);
+    static void SampleGuarantees(void);
 
     bool HaveQuota(void) const {
         return SpaceLimit || InodeLimit;
@@ -164,3 +184,8 @@ extern TPath VolumesKV;
 static inline std::unique_lock<std::mutex> LockVolumes() {
     return std::unique_lock<std::mutex>(VolumesMutex);
 }
+
+extern void StartGuaranteeSampler();
+extern void StopGuaranteeSampler();
+extern void StartQuotaWorkers();
+extern void StopQuotaWorkers();
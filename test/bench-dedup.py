@@ -0,0 +1,107 @@
+#!/usr/bin/python
+
+# Layer import benchmark for content-addressed layer store
+#
+# usage: bench-dedup.py [layers] [files] [size]
+#
+# Imports given amount of layers which share all files except one and
+# prints import latency and space saved. Then reads all files through one
+# volume per layer with cold page cache and prints page cache growth:
+# shared objects are cached once. Enable volumes.layer_dedup in config to
+# compare with plain import. Must be run as root to drop caches.
+
+import porto
+import sys
+import os
+import shutil
+import tarfile
+import time
+
+layers = int(sys.argv[1]) if len(sys.argv) > 1 else 10
+files = int(sys.argv[2]) if len(sys.argv) > 2 else 1000
+size = int(sys.argv[3]) if len(sys.argv) > 3 else 65536
+
+base = "/tmp/porto-bench-dedup"
+
+def cached():
+    with open("/proc/meminfo") as f:
+        for line in f:
+            if line.startswith("Cached:"):
+                return int(line.split()[1]) * 1024
+
+def drop_caches():
+    os.system("sync")
+    with open("/proc/sys/vm/drop_caches", "w") as f:
+        f.write("3")
+
+def read_tree(path):
+    for root, dirs, names in os.walk(path):
+        for name in names:
+            with open(os.path.join(root, name)) as f:
+                while f.read(1 << 20):
+                    pass
+
+def stat(c):
+    return int(c.GetData("/", "porto_stat[layer_dedup_files]")), \
+           int(c.GetData("/", "porto_stat[layer_dedup_bytes]"))
+
+if os.path.exists(base):
+    shutil.rmtree(base)
+os.makedirs(base + "/shared")
+
+for i in range(files):
+    with open("{}/shared/file-{}".format(base, i), "w") as f:
+        f.write(os.urandom(size))
+
+c = porto.Connection()
+c.connect()
+
+latency = []
+files_before, bytes_before = stat(c)
+
+for i in range(layers):
+    name = "bench-dedup-{}".format(i)
+    tarball = "{}/{}.tgz".format(base, name)
+
+    with open(base + "/unique", "w") as f:
+        f.write(os.urandom(size))
+
+    with tarfile.open(tarball, "w:gz") as t:
+        t.add(base + "/shared", arcname="shared")
+        t.add(base + "/unique", arcname="unique")
+
+    try:
+        c.RemoveLayer(name)
+    except porto.exceptions.LayerNotFound:
+        pass
+
+    start = time.time()
+    c.ImportLayer(name, tarball)
+    latency.append(time.time() - start)
+
+files_after, bytes_after = stat(c)
+
+volumes = []
+for i in range(layers):
+    volumes.append(c.CreateVolume(layers=["bench-dedup-{}".format(i)]))
+
+drop_caches()
+cache_before = cached()
+for v in volumes:
+    read_tree(v.path)
+cache_growth = cached() - cache_before
+
+for v in volumes:
+    v.Unlink()
+
+for i in range(layers):
+    c.RemoveLayer("bench-dedup-{}".format(i))
+
+shutil.rmtree(base)
+
+latency.sort()
+
+print("layers={} files={} size={} min={:.1f}ms median={:.1f}ms max={:.1f}ms dedup_files={} dedup_bytes={} read_bytes={} page_cache_bytes={}".format(
+      layers, files, size, latency[0] * 1000, latency[len(latency) // 2] * 1000, latency[-1] * 1000,
+      files_after - files_before, bytes_after - bytes_before,
+      layers * (files + 1) * size, cache_growth))
@@ -0,0 +1,65 @@
+#!/usr/bin/python
+
+# Container stop latency benchmark for large task counts
+#
+# usage: bench-kill.py [tasks] [procs|threads|forkbomb] [rounds]
+#
+# Starts container with given amount of processes or threads, waits
+# until all of them are in place and measures how long stop takes.
+# Forkbomb mode keeps forking until container is stopped.
+
+import porto
+import sys
+import os
+import time
+
+tasks = int(sys.argv[1]) if len(sys.argv) > 1 else 10000
+mode = sys.argv[2] if len(sys.argv) > 2 else "procs"
+rounds = int(sys.argv[3]) if len(sys.argv) > 3 else 5
+
+if mode == "procs":
+    command = "bash -c 'for i in $(seq {}); do sleep 1000 & done; wait'".format(tasks)
+elif mode == "threads":
+    command = "python -c 'import threading, time; " \
+              "[threading.Thread(target=time.sleep, args=(1000,)).start() for i in range({})]'".format(tasks)
+elif mode == "forkbomb":
+    command = "bash -c 'f() { sleep 1000 & f & }; f; wait'"
+else:
+    raise Exception("unknown mode " + mode)
+
+c = porto.Connection()
+c.connect()
+
+name = "bench-kill"
+
+try:
+    c.Destroy(name)
+except porto.exceptions.ContainerDoesNotExist:
+    pass
+
+latency = []
+
+for i in range(rounds):
+    r = c.Create(name)
+    r.SetProperty("command", command)
+    r.Start()
+
+    cg = r.GetData("cgroups[freezer]")
+    knob = cg + ("/tasks" if os.path.exists(cg + "/tasks") else "/cgroup.threads")
+
+    deadline = time.time() + (1 if mode == "forkbomb" else 60)
+    while time.time() < deadline:
+        if len(open(knob).readlines()) >= tasks:
+            break
+        time.sleep(0.1)
+
+    start = time.time()
+    r.Stop()
+    latency.append(time.time() - start)
+
+    r.Destroy()
+
+latency.sort()
+
+print("mode={} tasks={} rounds={} min={:.1f}ms median={:.1f}ms max={:.1f}ms".format(
+      mode, tasks, rounds, latency[0] * 1000, latency[len(latency) // 2] * 1000, latency[-1] * 1000))
@@ -0,0 +1,52 @@
+#!/usr/bin/python
+
+# Container start latency benchmark
+#
+# usage: bench-start.py [count] [isolate]
+#
+# Starts and destroys count containers with separate root and prints
+# start latency percentiles. Containers with isolate=false share pid
+# namespace with portod and get /proc from root template if enabled.
+
+import porto
+import sys
+import os
+import time
+
+count = int(sys.argv[1]) if len(sys.argv) > 1 else 100
+isolate = sys.argv[2] if len(sys.argv) > 2 else "true"
+
+root = "/tmp/porto-bench-root"
+binds = [d for d in ["/bin", "/sbin", "/lib", "/lib64", "/usr", "/etc"] if os.path.exists(d)]
+
+for d in binds:
+    if not os.path.exists(root + d):
+        os.makedirs(root + d)
+
+c = porto.Connection()
+c.connect()
+
+latency = []
+
+for i in range(count):
+    name = "bench-start-{}".format(i)
+    r = c.Create(name)
+    r.SetProperty("root", root)
+    r.SetProperty("bind", ";".join(["{} {} ro".format(d, d) for d in binds]))
+    r.SetProperty("isolate", isolate)
+    r.SetProperty("command", "true")
+
+    start = time.time()
+    r.Start()
+    latency.append(time.time() - start)
+
+    r.Wait()
+    r.Destroy()
+
+latency.sort()
+
+def pct(p):
+    return latency[min(len(latency) - 1, int(len(latency) * p / 100))] * 1000
+
+print("isolate={} count={} min={:.2f}ms p50={:.2f}ms p90={:.2f}ms p99={:.2f}ms max={:.2f}ms".format(
+      isolate, count, latency[0] * 1000, pct(50), pct(90), pct(99), latency[-1] * 1000))
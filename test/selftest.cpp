@@ -2836,6 +2836,32 @@ static void TestIdmap(Porto::Connection &api) {
 
     ExpectSuccess(idmap.Get(id));
     ExpectEq(id, 1);
+
+    for (int i = 2; i <= (int)CONTAINER_ID_MAX; i++)
+        ExpectSuccess(idmap.Get(id));
+    ExpectEq(id, CONTAINER_ID_MAX);
+    Expect(!!idmap.Get(id));
+
+    ExpectSuccess(idmap.Put(4097));
+    ExpectSuccess(idmap.Put(65));
+    Expect(!!idmap.Put(65));
+    ExpectSuccess(idmap.Get(id));
+    ExpectEq(id, 65);
+    ExpectSuccess(idmap.Get(id));
+    ExpectEq(id, 4097);
+    Expect(!!idmap.GetAt(64));
+
+    TIdMap natmap(0, 0);
+    Expect(!!natmap.Get(id));
+    natmap.Resize(100);
+    for (int i = 0; i < 100; i++) {
+        ExpectSuccess(natmap.Get(id));
+        ExpectEq(id, i);
+    }
+    Expect(!!natmap.Get(id));
+    natmap.Resize(130);
+    ExpectSuccess(natmap.Get(id));
+    ExpectEq(id, 100);
 }
 
 static void TestFormat(Porto::Connection &api) {
@@ -3752,6 +3778,28 @@ static void TestDynamic(Porto::Connection &api) {
     ExpectApiSuccess(api.Destroy(name));
 }
 
+/* Recount cached memory_guarantee_total of subtree, returns reference value */
+static uint64_t ExpectMemGuaranteeTotal(Porto::Connection &api, const std::string &name) {
+    std::vector<std::string> containers;
+    uint64_t guarantee, total, sum = 0;
+    string v;
+
+    ExpectApiSuccess(api.List(containers));
+    for (auto &ct: containers) {
+        if (StringStartsWith(ct, name + "/") &&
+                ct.find('/', name.size() + 1) == std::string::npos)
+            sum += ExpectMemGuaranteeTotal(api, ct);
+    }
+
+    ExpectApiSuccess(api.GetProperty(name, "memory_guarantee", v));
+    ExpectSuccess(StringToUint64(v, guarantee));
+    ExpectApiSuccess(api.GetData(name, "memory_guarantee_total", v));
+    ExpectSuccess(StringToUint64(v, total));
+    ExpectEq(total, std::max(guarantee, sum));
+
+    return total;
+}
+
 static void TestLimitsHierarchy(Porto::Connection &api) {
     if (!KernelSupports(KernelFeature::LOW_LIMIT))
         return;
@@ -3794,13 +3842,16 @@ static void TestLimitsHierarchy(Porto::Connection &api) {
     ExpectApiSuccess(api.SetProperty(slot1, "memory_guarantee", std::to_string(chunk)));
     ExpectApiFailure(api.SetProperty(slot2, "memory_guarantee", std::to_string(chunk + 1)), EError::ResourceNotAvailable);
     ExpectApiSuccess(api.SetProperty(slot2, "memory_guarantee", std::to_string(chunk)));
+    ExpectMemGuaranteeTotal(api, box);
 
     ExpectApiSuccess(api.SetProperty(monit, "memory_guarantee", std::to_string(0)));
     ExpectApiSuccess(api.SetProperty(system, "memory_guarantee", std::to_string(0)));
+    ExpectMemGuaranteeTotal(api, box);
 
     ExpectApiSuccess(api.Destroy(monit));
     ExpectApiSuccess(api.Destroy(system));
     ExpectApiSuccess(api.Destroy(slot2));
+    ExpectMemGuaranteeTotal(api, box);
     ExpectApiSuccess(api.Destroy(slot1));
     ExpectApiSuccess(api.Destroy(prod));
     ExpectApiSuccess(api.Destroy(box));
@@ -4363,6 +4414,86 @@ static void TestPerf(Porto::Connection &api) {
     Expect(ms < destroyMs * nr);
 }
 
+static void TestChurn(Porto::Connection &api) {
+    uint64_t begin, ms;
+    const int nr = 1000;
+    const int rounds = 10;
+    const int churnMs = 50;
+
+    for (int i = 0; i < nr; i++)
+        ExpectApiSuccess(api.Create("churn" + std::to_string(i)));
+
+    begin = GetCurrentTimeMs();
+    for (int r = 0; r < rounds; r++) {
+        for (int i = r % 2; i < nr; i += 2)
+            ExpectApiSuccess(api.Destroy("churn" + std::to_string(i)));
+        for (int i = r % 2; i < nr; i += 2)
+            ExpectApiSuccess(api.Create("churn" + std::to_string(i)));
+    }
+    ms = GetCurrentTimeMs() - begin;
+    Say() << "Churn " << rounds * nr << " create/destroy took " << ms / 1000.0 << "s" << std::endl;
+    Expect(ms < churnMs * rounds * nr);
+
+    for (int i = 0; i < nr; i++)
+        ExpectApiSuccess(api.Destroy("churn" + std::to_string(i)));
+}
+
+static void TestLoopPerf(Porto::Connection &api) {
+    std::map<std::string, std::string> prop_loop = {{"backend", "loop"}, {"space_limit", "1g"}};
+    TPath tmpl = TPath(config().volumes().default_place()) /
+                 config().volumes().templates_dir() / "ext4-1073741824.img";
+    bool templates = config().volumes().loop_templates();
+    uint64_t begin, cold, warm = 0;
+    struct stat tmpl_st;
+    std::string tmpl_uuid;
+    const int nr = 10;
+    std::string path;
+
+    for (int i = 0; i < nr; i++) {
+        path = "";
+        begin = GetCurrentTimeMs();
+        ExpectApiSuccess(api.CreateVolume(path, prop_loop));
+        if (i)
+            warm += GetCurrentTimeMs() - begin;
+        else
+            cold = GetCurrentTimeMs() - begin;
+
+        if (templates) {
+            vector<string> lines;
+            ExpectSuccess(Popen("cat /proc/self/mountinfo", lines));
+            auto m = ParseMountinfo(lines);
+            Expect(m.find(path) != m.end());
+
+            /* Cloned filesystem keeps UUID of its template */
+            AsRoot(api);
+            std::string uuid = System("blkid -s UUID -o value " + m[path].source);
+            if (!i) {
+                ExpectSuccess(tmpl.StatStrict(tmpl_st));
+                tmpl_uuid = System("blkid -s UUID -o value " + tmpl.ToString());
+                Expect(tmpl_uuid != "");
+            }
+            AsAlice(api);
+            ExpectEq(uuid, tmpl_uuid);
+        }
+
+        ExpectApiSuccess(api.UnlinkVolume(path, ""));
+    }
+    warm /= nr - 1;
+
+    Say() << "Create loop volume took " << cold << "ms first, "
+          << warm << "ms average next" << std::endl;
+
+    if (templates) {
+        /* Template is made once and reused */
+        struct stat st;
+        AsRoot(api);
+        ExpectSuccess(tmpl.StatStrict(st));
+        AsAlice(api);
+        ExpectEq(st.st_ino, tmpl_st.st_ino);
+        ExpectEq((size_t)st.st_mtime, (size_t)tmpl_st.st_mtime);
+    }
+}
+
 static void CleanupVolume(Porto::Connection &api, const std::string &path) {
     AsRoot(api);
     TPath dir(path);
@@ -5348,6 +5479,8 @@ int SelfTest(std::vector<std::string> args) {
         { "convert", TestConvertPath },
         { "leaks", TestLeaks },
         { "perf", TestPerf },
+        { "churn", TestChurn },
+        { "loop_perf", TestLoopPerf },
 
         // the following tests will restart porto several times
         { "bad_client", TestBadClient },
@@ -1,6 +1,7 @@
 import porto
 import sys
 import os
+import time
 
 import test_common
 from test_common import *
@@ -25,6 +26,7 @@ r.GetData('cpu_usage')
 
 prefix = "test-api.py-"
 container_name = prefix + "a"
+pool_name = prefix + "pool"
 layer_name = prefix + "layer"
 volume_private = prefix + "volume"
 volume_size = 256*(2**20)
@@ -37,6 +39,9 @@ tarball_path = "/tmp/" + prefix + "layer.tgz"
 if not Catch(c.Find, container_name):
     c.Destroy(container_name)
 
+if not Catch(c.Find, pool_name):
+    c.Destroy(pool_name)
+
 if not Catch(c.FindVolume, volume_path):
     c.DestroyVolume(volume_path)
 
@@ -50,6 +55,9 @@ for v in c.ListVolumes():
 if not Catch(c.FindLayer, layer_name):
     c.RemoveLayer(layer_name)
 
+if not Catch(c.FindLayer, layer_name + "-gc"):
+    c.RemoveLayer(layer_name + "-gc")
+
 if os.access(tarball_path, os.F_OK):
     os.unlink(tarball_path)
 
@@ -68,6 +76,8 @@ a.Start()
 assert a.Wait() == a.name
 assert a.GetData("state") == "dead"
 assert a.GetData("exit_status") == "0"
+assert int(a.GetData("start_timings[total]")) >= int(a.GetData("start_timings[fork]"))
+assert int(c.GetData("/", "porto_stat[start_latency_le_inf]")) > 0
 
 assert c.Wait(['*']) == a.name
 
@@ -98,6 +108,69 @@ a.Start()
 assert a.Wait() == a.name
 assert a.GetData("exit_status") == "0"
 assert a.GetData("stdout") == "test\n"
+
+a.Stop()
+a.SetProperty("command", "sleep 60")
+b = c.Create(container_name + "/b")
+b.SetProperty("command", "sleep 60")
+res = c.StartBulk(subtree=container_name)
+assert res[container_name][0] == 0 and res[b.name][0] == 0
+assert b.GetData("state") == "running"
+res = c.StopBulk([b.name, container_name])
+assert len(res) == 2 and res[b.name][0] == 0
+assert a.GetData("state") == "stopped"
+
+if "memory_guarantee" in c.Plist():
+    root_total = int(c.GetData("/", "memory_guarantee_total"))
+    b.SetProperty("memory_guarantee", "1M")
+    assert int(a.GetData("memory_guarantee_total")) == 2**20
+    a.SetProperty("memory_guarantee", "2M")
+    assert int(a.GetData("memory_guarantee_total")) == 2 * 2**20
+    a.SetProperty("memory_guarantee", "0")
+    c.Destroy(b)
+    assert int(a.GetData("memory_guarantee_total")) == 0
+    assert int(c.GetData("/", "memory_guarantee_total")) == root_total
+else:
+    c.Destroy(b)
+
+# Cgroup pool is disabled for cgroup v2
+if not os.path.exists("/sys/fs/cgroup/cgroup.controllers"):
+    def WaitRecycled(recycled, count):
+        for i in range(50):
+            if int(c.GetData("/", "porto_stat[cgroups_recycled]")) >= recycled + count:
+                break
+            time.sleep(0.1)
+        assert int(c.GetData("/", "porto_stat[cgroups_recycled]")) >= recycled + count
+
+    pooled = int(c.GetData("/", "porto_stat[cgroups_pooled]"))
+    recycled = int(c.GetData("/", "porto_stat[cgroups_recycled]"))
+    a.SetProperty("command", "sleep 60")
+    a.Start()
+    assert int(c.GetData("/", "porto_stat[cgroups_pooled]")) > pooled
+    default_rules = open(a.GetData("cgroups[devices]") + "/devices.list").read()
+    a.Stop()
+    WaitRecycled(recycled, 1)
+
+    # Devices cgroup with custom rules is created, pooled one is held by p
+    a.SetProperty("devices", "/dev/kmsg r")
+    a.Start()
+    assert "c 1:11 r" in open(a.GetData("cgroups[devices]") + "/devices.list").read()
+    p = c.Create(pool_name)
+    p.SetProperty("command", "sleep 60")
+    p.Start()
+    recycled = int(c.GetData("/", "porto_stat[cgroups_recycled]"))
+    # Both freezer and devices cgroups are recycled
+    a.Stop()
+    WaitRecycled(recycled, 2)
+
+    # Last recycled cgroup is taken first
+    a.SetProperty("devices", "")
+    a.Start()
+    assert open(a.GetData("cgroups[devices]") + "/devices.list").read() == default_rules
+    assert open(a.GetData("cgroups[freezer]") + "/freezer.state").read().strip() == "THAWED"
+    a.Stop()
+    c.Destroy(p)
+
 c.Destroy(a)
 
 assert Catch(c.Find, container_name) == porto.exceptions.ContainerDoesNotExist
@@ -151,6 +224,11 @@ w.Unlink()
 assert len(w.GetContainers()) == 1
 assert w.GetContainers()[0].name == container_name
 assert Catch(l.Remove) == porto.exceptions.Busy
+gc_layer = c.ImportLayer(layer_name + "-gc", tarball_path)
+collected = c.CollectLayers(dry_run=True, high_watermark=0, low_watermark=0, min_age=0)
+assert gc_layer.name in collected
+assert layer_name not in collected
+gc_layer.Remove()
 
 v.Unlink()
 assert Catch(c.FindVolume, v.path) == porto.exceptions.VolumeNotFound